@@ -0,0 +1,197 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_BIT_VOXELS_H
+#define SHAPES_BIT_VOXELS_H 1
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <tr1/cstdint>
+
+namespace shapes
+{
+
+/*
+ * A binary volume with one bit per voxel. Voxels are indexed [x][y][z] as
+ * in a cvmlcpp::Matrix; each row along the z-axis starts in a new word,
+ * with voxel z in bit z % wordBits of word z / wordBits.
+ */
+class BitVoxels
+{
+	public:
+		typedef std::tr1::uint64_t Word;
+		static const std::size_t wordBits = 64;
+
+		BitVoxels() : rowWords_(0)
+		{ dims_[0] = dims_[1] = dims_[2] = 0; }
+
+		BitVoxels(const std::size_t dimX, const std::size_t dimY,
+			  const std::size_t dimZ) : rowWords_(0)
+		{ this->resize(dimX, dimY, dimZ); }
+
+		// All voxels become 0
+		void resize(const std::size_t dimX, const std::size_t dimY,
+			    const std::size_t dimZ)
+		{
+			dims_[0] = dimX;
+			dims_[1] = dimY;
+			dims_[2] = dimZ;
+			rowWords_ = (dimZ + wordBits - 1) / wordBits;
+			words_.assign(dimX * dimY * rowWords_, Word(0));
+		}
+
+		void clear() { this->resize(0, 0, 0); }
+
+		bool empty() const { return words_.empty(); }
+
+		std::size_t extent(const unsigned dim) const
+		{
+			assert(dim < 3);
+			return dims_[dim];
+		}
+
+		// Words per row along the z-axis
+		std::size_t rowWords() const { return rowWords_; }
+
+		Word *row(const std::size_t x, const std::size_t y)
+		{ return &words_[(x * dims_[1] + y) * rowWords_]; }
+
+		const Word *row(const std::size_t x, const std::size_t y) const
+		{ return &words_[(x * dims_[1] + y) * rowWords_]; }
+
+		bool operator()(const std::size_t x, const std::size_t y,
+				const std::size_t z) const
+		{
+			assert(x < dims_[0] && y < dims_[1] && z < dims_[2]);
+			return (this->row(x, y)[z / wordBits] >> (z % wordBits)) & 1u;
+		}
+
+		void set(const std::size_t x, const std::size_t y,
+			 const std::size_t z, const bool value)
+		{
+			assert(x < dims_[0] && y < dims_[1] && z < dims_[2]);
+			const Word bit = Word(1) << (z % wordBits);
+			Word &word = this->row(x, y)[z / wordBits];
+			word = value ? (word | bit) : (word & ~bit);
+		}
+
+		// Set voxels [zBegin, zEnd) of row (x, y)
+		void fill(const std::size_t x, const std::size_t y,
+			  std::size_t zBegin, const std::size_t zEnd)
+		{
+			assert(zBegin <= zEnd && zEnd <= dims_[2]);
+			Word * const words = this->row(x, y);
+			while (zBegin < zEnd)
+			{
+				const std::size_t bit = zBegin % wordBits;
+				const std::size_t n = std::min(wordBits - bit, zEnd - zBegin);
+				const Word ones = (n == wordBits) ? ~Word(0) : (Word(1) << n) - 1u;
+				words[zBegin / wordBits] |= ones << bit;
+				zBegin += n;
+			}
+		}
+
+		const std::vector<Word> &words() const { return words_; }
+		std::vector<Word> &words() { return words_; }
+
+	private:
+		std::size_t dims_[3];
+		std::size_t rowWords_;
+		std::vector<Word> words_;
+};
+
+namespace io {
+
+/*
+ * A line "BitVoxels dimX dimY dimZ", followed by the words of the rows as
+ * stored in memory, little-endian as on x86.
+ */
+inline bool writeBitVoxels(const BitVoxels &voxels, const std::string fileName)
+{
+	std::ofstream out(fileName.c_str(), std::ios::out    |
+					    std::ios::binary |
+					    std::ios::trunc);
+	out << "BitVoxels " << voxels.extent(0) << " " << voxels.extent(1)
+	    << " " << voxels.extent(2) << "\n";
+	if (!voxels.empty())
+		out.write((const char *)&voxels.words()[0],
+			  voxels.words().size() * sizeof(BitVoxels::Word));
+	out.close();
+
+	return !out.fail();
+}
+
+inline bool readBitVoxels(const std::string fileName, BitVoxels &voxels)
+{
+	std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+	std::string magic;
+	std::tr1::uint64_t dims[3];
+	in >> magic >> dims[0] >> dims[1] >> dims[2];
+	if (!in.good() || magic != "BitVoxels" || in.get() != '\n')
+	{
+		std::cout << "Error reading bit voxels from file ["
+			  << fileName << "]." << std::endl;
+		return false;
+	}
+
+	// Bytes after the header
+	const std::streampos here = in.tellg();
+	in.seekg(0, std::ios::end);
+	const std::tr1::uint64_t left = in.tellg() - here;
+	in.seekg(here);
+
+	// Check the header against the size of the file before allocating
+	const std::tr1::uint64_t rows = dims[0] * dims[1];
+	const std::tr1::uint64_t rowWords = dims[2] / BitVoxels::wordBits +
+				(dims[2] % BitVoxels::wordBits != 0 ? 1u : 0u);
+	if (in.fail() || (dims[0] != 0 && rows / dims[0] != dims[1]) ||
+	    (rowWords != 0 && rows > left / sizeof(BitVoxels::Word) / rowWords))
+	{
+		std::cout << "Error reading bit voxels from file ["
+			  << fileName << "]: invalid size or file too short."
+			  << std::endl;
+		return false;
+	}
+
+	voxels.resize(dims[0], dims[1], dims[2]);
+	if (!voxels.empty())
+		in.read((char *)&voxels.words()[0],
+			voxels.words().size() * sizeof(BitVoxels::Word));
+	if (in.fail())
+	{
+		std::cout << "Error reading bit voxels from file ["
+			  << fileName << "]: file too short." << std::endl;
+		voxels.clear();
+		return false;
+	}
+
+	return true;
+}
+
+} // end namespace io
+
+} // end namespace shapes
+
+#endif
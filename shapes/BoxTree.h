@@ -0,0 +1,229 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_BOX_TREE_H
+#define SHAPES_BOX_TREE_H 1
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include <shapes/EuclidTypes.h>
+
+namespace shapes
+{
+
+namespace detail
+{
+
+template <typename T>
+bool boxesOverlap(const typename EuclidTypes<T>::FPPoint &lower0,
+		  const typename EuclidTypes<T>::FPPoint &upper0,
+		  const typename EuclidTypes<T>::FPPoint &lower1,
+		  const typename EuclidTypes<T>::FPPoint &upper1)
+{
+	for (unsigned d = 0; d < 3; ++d)
+		if (lower0[d] > upper1[d] || lower1[d] > upper0[d])
+			return false;
+	return true;
+}
+
+} // end namespace detail
+
+/*
+ * Bounding volume hierarchy over a set of axis-aligned boxes, each with an
+ * index. The boxes are split in halves along their longest extent until at
+ * most leafSize remain.
+ */
+template <typename T>
+class BoxTree
+{
+	public:
+		typedef typename EuclidTypes<T>::FPPoint FPPoint;
+
+		bool empty() const { return nodes.empty(); }
+
+		void clear()
+		{
+			nodes.clear();
+			items.clear();
+			itemLower.clear();
+			itemUpper.clear();
+		}
+
+		// Index the boxes (lower[i], upper[i]) of the given items
+		void build(const std::vector<FPPoint> &lower,
+			   const std::vector<FPPoint> &upper,
+			   const std::vector<std::size_t> &_items)
+		{
+			this->clear();
+			items = _items;
+			if (items.empty())
+				return;
+
+			nodes.resize(1u);
+			this->buildAt(0u, lower, upper, 0u, items.size());
+
+			itemLower.resize(items.size());
+			itemUpper.resize(items.size());
+			for (std::size_t i = 0; i < items.size(); ++i)
+			{
+				itemLower[i] = lower[items[i]];
+				itemUpper[i] = upper[items[i]];
+			}
+		}
+
+		// Append the items with a box overlapping [lower, upper] to hits
+		void query(const FPPoint &lower, const FPPoint &upper,
+			   std::vector<std::size_t> &hits) const
+		{
+			if (nodes.empty())
+				return;
+
+			// Halving the items, the depth is at most log2 of their
+			// number, and each level leaves at most one node waiting.
+			std::size_t stack[maxDepth + 1u];
+			std::size_t top = 0;
+			stack[top++] = 0u;
+			while (top > 0u)
+			{
+				const Node &node = nodes[stack[--top]];
+
+				if (!detail::boxesOverlap<T>(lower, upper, node.lower, node.upper))
+					continue;
+
+				if (node.count > 0u)
+				{
+					for (std::size_t i = node.first; i < node.first + node.count; ++i)
+						if (detail::boxesOverlap<T>(lower, upper,
+						    itemLower[i], itemUpper[i]))
+							hits.push_back(items[i]);
+				}
+				else
+				{
+					assert(top + 2u <= maxDepth + 1u);
+					stack[top++] = node.first;
+					stack[top++] = node.first + 1u;
+				}
+			}
+		}
+
+		/*
+		 * For other traversals: nodes are numbered from the root, 0,
+		 * and the children of a node come after it. A leaf holds the
+		 * items item(leafBegin(node)) up to item(leafEnd(node)).
+		 */
+		std::size_t nodeCount() const { return nodes.size(); }
+
+		const FPPoint &nodeLower(const std::size_t node) const { return nodes[node].lower; }
+		const FPPoint &nodeUpper(const std::size_t node) const { return nodes[node].upper; }
+
+		bool isLeaf(const std::size_t node) const { return nodes[node].count > 0u; }
+
+		// The children of an inner node are firstChild() and the next one
+		std::size_t firstChild(const std::size_t node) const { return nodes[node].first; }
+
+		std::size_t leafBegin(const std::size_t node) const { return nodes[node].first; }
+		std::size_t leafEnd  (const std::size_t node) const
+		{ return nodes[node].first + nodes[node].count; }
+
+		std::size_t item(const std::size_t i) const { return items[i]; }
+
+	private:
+		enum { leafSize = 4, maxDepth = 8 * sizeof(std::size_t) };
+
+		// A leaf holds items[first, first + count); an inner node has
+		// count 0 and its children at nodes[first] and nodes[first + 1].
+		struct Node
+		{
+			FPPoint lower, upper;
+			std::size_t first, count;
+		};
+		std::vector<Node> nodes;
+
+		std::vector<std::size_t> items;
+		// Boxes of the items, in the same order
+		std::vector<FPPoint> itemLower, itemUpper;
+
+		// Orders items by the center of their box along one axis
+		struct CenterLess
+		{
+			const std::vector<FPPoint> &lower, &upper;
+			const unsigned axis;
+
+			CenterLess(const std::vector<FPPoint> &_lower,
+				   const std::vector<FPPoint> &_upper, const unsigned _axis) :
+				lower(_lower), upper(_upper), axis(_axis) { }
+
+			bool operator()(const std::size_t a, const std::size_t b) const
+			{
+				return lower[a][axis] + upper[a][axis] <
+				       lower[b][axis] + upper[b][axis];
+			}
+		};
+
+		// Fill nodes[index] for items[first, first + count)
+		void buildAt(const std::size_t index,
+			     const std::vector<FPPoint> &lower,
+			     const std::vector<FPPoint> &upper,
+			     const std::size_t first, const std::size_t count)
+		{
+			FPPoint nodeLower = lower[items[first]];
+			FPPoint nodeUpper = upper[items[first]];
+			for (std::size_t i = first + 1u; i < first + count; ++i)
+				for (unsigned d = 0; d < 3; ++d)
+				{
+					nodeLower[d] = std::min(nodeLower[d], lower[items[i]][d]);
+					nodeUpper[d] = std::max(nodeUpper[d], upper[items[i]][d]);
+				}
+			nodes[index].lower = nodeLower;
+			nodes[index].upper = nodeUpper;
+
+			if (count <= std::size_t(leafSize))
+			{
+				nodes[index].first = first;
+				nodes[index].count = count;
+				return;
+			}
+
+			unsigned axis = 0;
+			for (unsigned d = 1; d < 3; ++d)
+				if (nodeUpper[d] - nodeLower[d] > nodeUpper[axis] - nodeLower[axis])
+					axis = d;
+
+			const std::size_t half = count / 2u;
+			std::nth_element(items.begin() + first, items.begin() + first + half,
+					 items.begin() + first + count,
+					 CenterLess(lower, upper, axis));
+
+			// Children are adjacent
+			const std::size_t children = nodes.size();
+			nodes.resize(children + 2u);
+			nodes[index].first = children;
+			nodes[index].count = 0u;
+			this->buildAt(children,      lower, upper, first, half);
+			this->buildAt(children + 1u, lower, upper, first + half, count - half);
+		}
+};
+
+} // end namespace
+
+#endif
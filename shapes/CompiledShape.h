@@ -0,0 +1,205 @@
+/***************************************************************************
+ *   Copyright (C) 2011 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_COMPILED_SHAPE_H
+#define SHAPES_COMPILED_SHAPE_H 1
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <ostream>
+#include <tr1/memory>
+
+#include <shapes/Shape.h>
+
+namespace shapes
+{
+
+/*
+ * A Shape lowered to a flat list of instructions, executed for blocks of
+ * points at a time. Each instruction leaves its result in a slot, i.e.
+ * an array of Structure<T>::blockSize values. Unions, Intersections,
+ * Differences and Spheres are evaluated by the interpreter itself; other
+ * structures are called as a whole for each block.
+ *
+ * The CompiledShape holds on to the structures of the Shape, but changes
+ * made to them after compilation are not seen.
+ *
+ * compileNative() turns the instructions into C++ code with all constants
+ * built in, compiles it with the system compiler and loads the result, which
+ * then replaces the interpreter. Structures other than Spheres and their
+ * combinations are still called as a whole.
+ */
+template <typename T>
+class CompiledShape
+{
+	public:
+		typedef typename Structure<T>::FPPoint  FPPoint;
+		typedef typename Structure<T>::FPVector FPVector;
+
+		CompiledShape() : slots_(0), native(NULL) { }
+
+		CompiledShape(const Shape<T> &shape) : slots_(0), native(NULL)
+		{ this->compile(shape); }
+
+		void compile(const Shape<T> &shape);
+
+		void clear();
+
+		bool empty() const { return structure_ == NULL; }
+
+		void getBoundingBox(FPPoint &_minCorner,
+				    FPPoint &_maxCorner) const
+		{
+			_minCorner = minCorner;
+			_maxCorner = maxCorner;
+		}
+
+		std::size_t size() const { return instructions.size(); }
+
+		// Compile the instructions to native code with $CXX (default: c++)
+		// and use it for evaluation. The shared object is cached in
+		// cacheDir, by default $SHAPES_NATIVE_CACHE, $XDG_CACHE_HOME/shapes
+		// or ~/.cache/shapes, under a hash of the code. The directory and
+		// the files in it must belong to the user and not be writable by
+		// others. On failure, the interpreter remains in use.
+		bool compileNative(std::string cacheDir = "");
+
+		bool isNative() const { return native != NULL; }
+
+		// The code compiled by compileNative()
+		void writeSource(std::ostream &os) const;
+
+		T value(const FPPoint &p) const
+		{
+			T v;
+			this->values(&p, &v, 1);
+			return v;
+		}
+
+		void values(const FPPoint * const pts, T * const out,
+			    const std::size_t n) const;
+
+		// Evaluate n points on a grid row: first, first + step, ...
+		void values(const FPPoint &first, const FPVector &step,
+			    T * const out, const std::size_t n) const;
+
+		// Whether value(p) >= 1; compiled code evaluates all of the
+		// shape, so this does not stop early.
+		bool inside(const FPPoint &p) const { return this->value(p) >= T(1); }
+
+		void inside(const FPPoint * const pts, bool * const out,
+			    const std::size_t n) const
+		{
+			T v[Structure<T>::blockSize];
+			for (std::size_t i = 0; i < n; i += Structure<T>::blockSize)
+			{
+				const std::size_t m = std::min(std::size_t(Structure<T>::blockSize), n - i);
+				this->values(pts + i, v, m);
+				for (std::size_t j = 0; j < m; ++j)
+					out[i + j] = v[j] >= T(1);
+			}
+		}
+
+		void inside(const FPPoint &first, const FPVector &step,
+			    bool * const out, const std::size_t n) const
+		{
+			T v[Structure<T>::blockSize];
+			for (std::size_t i = 0; i < n; i += Structure<T>::blockSize)
+			{
+				const std::size_t m = std::min(std::size_t(Structure<T>::blockSize), n - i);
+				this->values(first + step * T(i), step, v, m);
+				for (std::size_t j = 0; j < m; ++j)
+					out[i + j] = v[j] >= T(1);
+			}
+		}
+
+		/*
+		 * Code generation, used by Structure<T>::compile().
+		 */
+
+		// slot = structure->values()
+		void emitLeaf(const Structure<T> * const structure, const unsigned slot);
+
+		// slot = sphere with center c, fused orientation / weight
+		// matrix m, radius r and exponent e; not damped.
+		void emitSphere(const T c[3], const T m[3][3],
+				const T r, const T e, const unsigned slot);
+
+		// slot = 0
+		void emitClear(const unsigned slot);
+
+		// slot += pow(source, e)
+		void emitAccumulate(const unsigned slot, const unsigned source, const T e);
+
+		// slot = pow(slot, e)
+		void emitFinish(const unsigned slot, const T e);
+
+		// slot = damped(slot)
+		void emitDamping(const unsigned slot, const T dampLow, const T dampHigh);
+
+	private:
+		struct Instruction
+		{
+			enum Op { LEAF, SPHERE, CLEAR, ACCUMULATE, FINISH, DAMPING };
+
+			Op		op;
+			unsigned	slot, source;
+			// Index in 'parameters' or in 'leaves'
+			std::size_t	index;
+		};
+
+		// Layout of the parameters of a sphere
+		enum { CENTER = 0, TRANSFORM = 3, RADIUS = 12, EXPONENT = 13, SPHERE_PARAMS = 14 };
+
+		// Entry point of native code: points px, py, pz; values of the
+		// leaves, blockSize apart; output; number of points; damping.
+		typedef void (*NativeFunction)(const T *, const T *, const T *,
+					       const T *, T *, unsigned long,
+					       T (*)(T, T, T));
+
+		std::vector<Instruction>		instructions;
+		std::vector<T>				parameters;
+		std::vector<const Structure<T> *>	leaves;
+		unsigned				slots_;
+
+		std::tr1::shared_ptr<const Structure<T> > structure_;
+		FPPoint minCorner, maxCorner;
+
+		// Handle of the loaded library, and the function in it
+		std::tr1::shared_ptr<void> library;
+		NativeFunction native;
+
+		Instruction &emit(const typename Instruction::Op op, const unsigned slot);
+
+		void run(const FPPoint * const pts, T * const out, const std::size_t n,
+			 T * const slots) const;
+
+		// Slots needed by run(); native code keeps the values of all
+		// leaves instead.
+		std::size_t buffers() const
+		{ return native ? std::max<std::size_t>(leaves.size(), 1u) : slots_; }
+};
+
+} // end namespace
+
+#include <shapes/CompiledShape.hh>
+
+#endif
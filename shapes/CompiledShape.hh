@@ -0,0 +1,602 @@
+/***************************************************************************
+ *   Copyright (C) 2011 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SHAPES_HAVE_DLOPEN 1
+#include <cerrno>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include <shapes/Sphere.h>
+
+namespace shapes
+{
+
+namespace detail
+{
+
+template <typename T> struct NativeType;
+
+template <> struct NativeType<float>
+{ static const char *name() { return "float"; } static const char *suffix() { return "f"; } };
+
+template <> struct NativeType<double>
+{ static const char *name() { return "double"; } static const char *suffix() { return ""; } };
+
+template <> struct NativeType<long double>
+{ static const char *name() { return "long double"; } static const char *suffix() { return "L"; } };
+
+// Literal that reads back exactly as v
+template <typename T>
+std::string nativeLiteral(const T v)
+{
+	std::ostringstream os;
+	os.precision(std::numeric_limits<T>::digits10 + 3);
+	os << std::scientific << v << NativeType<T>::suffix();
+	return os.str();
+}
+
+// FNV-1a; collisions are caught by comparing the cached source.
+inline unsigned nativeHash(const std::string &s)
+{
+	unsigned h = 2166136261u;
+	for (std::string::const_iterator c = s.begin(); c != s.end(); ++c)
+		h = (h ^ static_cast<unsigned char>(*c)) * 16777619u;
+	return h;
+}
+
+#ifdef SHAPES_HAVE_DLOPEN
+// Owned by us and not writable by others; directories must be ours alone
+// so that no one else can put files in them.
+inline bool nativeTrusted(const std::string &path, const bool directory)
+{
+	struct stat info;
+	if (lstat(path.c_str(), &info) != 0 || info.st_uid != geteuid() ||
+	    (info.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+		return false;
+	return directory ? S_ISDIR(info.st_mode) : S_ISREG(info.st_mode);
+}
+
+// Create a directory only we can use, if it does not exist
+inline bool nativeMakeDir(const std::string &dir)
+{
+	if (mkdir(dir.c_str(), S_IRWXU) != 0 && errno != EEXIST)
+		return false;
+	return nativeTrusted(dir, true);
+}
+
+inline std::string nativeCacheDir()
+{
+	const char * const dir = std::getenv("SHAPES_NATIVE_CACHE");
+	if (dir != NULL)
+		return dir;
+
+	const char * const cache = std::getenv("XDG_CACHE_HOME");
+	if (cache != NULL && *cache != '\0')
+		return std::string(cache) + "/shapes";
+
+	const char * const home = std::getenv("HOME");
+	if (home == NULL || *home == '\0')
+		return "";
+	// ~/.cache itself is commonly shared with other programs
+	mkdir((std::string(home) + "/.cache").c_str(), S_IRWXU);
+	return std::string(home) + "/.cache/shapes";
+}
+
+// Is there a library compiled from exactly this source ?
+inline bool nativeCached(const std::string &sourceFile,
+			 const std::string &libraryFile, const std::string &source)
+{
+	if (!nativeTrusted(sourceFile, false) || !nativeTrusted(libraryFile, false))
+		return false;
+	std::ifstream cached(sourceFile.c_str(), std::ios::binary);
+	if (!cached)
+		return false;
+	const std::string contents( (std::istreambuf_iterator<char>(cached)),
+				     std::istreambuf_iterator<char>() );
+	return contents == source;
+}
+
+// Run a program without a shell; true if it exits with 0
+inline bool nativeRun(const std::vector<std::string> &args)
+{
+	std::vector<char *> argv;
+	for (std::size_t i = 0; i < args.size(); ++i)
+		argv.push_back(const_cast<char *>(args[i].c_str()));
+	argv.push_back(NULL);
+
+	const pid_t pid = fork();
+	if (pid < 0)
+		return false;
+	if (pid == 0)
+	{
+		execvp(argv[0], &argv[0]);
+		_exit(127);
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			return false;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// A new file with a unique name starting with 'prefix', only for us
+inline bool nativeTempFile(const std::string &prefix, std::string &name)
+{
+	std::vector<char> pattern(prefix.begin(), prefix.end());
+	const char suffix [] = ".XXXXXX";
+	pattern.insert(pattern.end(), suffix, suffix + sizeof(suffix));
+	const int fd = mkstemp(&pattern[0]);
+	if (fd < 0)
+		return false;
+	close(fd);
+	name = &pattern[0];
+	return true;
+}
+#endif
+
+} // end namespace detail
+
+template <typename T>
+void CompiledShape<T>::clear()
+{
+	instructions.clear();
+	parameters.clear();
+	leaves.clear();
+	slots_ = 0;
+	structure_ = std::tr1::shared_ptr<const Structure<T> >();
+	native  = NULL;
+	library = std::tr1::shared_ptr<void>();
+}
+
+template <typename T>
+void CompiledShape<T>::compile(const Shape<T> &shape)
+{
+	this->clear();
+	if (shape.empty())
+		return;
+
+	structure_ = shape.structure();
+	structure_->compile(*this, 0);
+	shape.getBoundingBox(minCorner, maxCorner);
+}
+
+template <typename T>
+typename CompiledShape<T>::Instruction &
+CompiledShape<T>::emit(const typename Instruction::Op op, const unsigned slot)
+{
+	slots_ = std::max(slots_, slot + 1u);
+
+	Instruction instruction;
+	instruction.op     = op;
+	instruction.slot   = slot;
+	instruction.source = slot;
+	instruction.index  = parameters.size();
+	instructions.push_back(instruction);
+
+	return instructions.back();
+}
+
+template <typename T>
+void CompiledShape<T>::emitLeaf(const Structure<T> * const structure, const unsigned slot)
+{
+	this->emit(Instruction::LEAF, slot).index = leaves.size();
+	leaves.push_back(structure);
+}
+
+template <typename T>
+void CompiledShape<T>::emitSphere(const T c[3], const T m[3][3],
+				  const T r, const T e, const unsigned slot)
+{
+	this->emit(Instruction::SPHERE, slot);
+	parameters.insert(parameters.end(), c, c + 3);
+	for (unsigned i = 0; i < 3; ++i)
+		parameters.insert(parameters.end(), m[i], m[i] + 3);
+	parameters.push_back(r);
+	parameters.push_back(e);
+	assert(parameters.size() == instructions.back().index + SPHERE_PARAMS);
+}
+
+template <typename T>
+void CompiledShape<T>::emitClear(const unsigned slot)
+{
+	this->emit(Instruction::CLEAR, slot);
+}
+
+template <typename T>
+void CompiledShape<T>::emitAccumulate(const unsigned slot, const unsigned source, const T e)
+{
+	this->emit(Instruction::ACCUMULATE, slot).source = source;
+	parameters.push_back(e);
+}
+
+template <typename T>
+void CompiledShape<T>::emitFinish(const unsigned slot, const T e)
+{
+	this->emit(Instruction::FINISH, slot);
+	parameters.push_back(e);
+}
+
+template <typename T>
+void CompiledShape<T>::emitDamping(const unsigned slot, const T dampLow, const T dampHigh)
+{
+	this->emit(Instruction::DAMPING, slot);
+	parameters.push_back(dampLow);
+	parameters.push_back(dampHigh);
+}
+
+template <typename T>
+void CompiledShape<T>::run(const FPPoint * const pts, T * const out,
+			   const std::size_t n, T * const slots) const
+{
+	const std::size_t blockSize = Structure<T>::blockSize;
+	assert(n <= blockSize);
+
+	// Structure-of-arrays copy of the block, shared by all spheres
+	T px[Structure<T>::blockSize];
+	T py[Structure<T>::blockSize];
+	T pz[Structure<T>::blockSize];
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		px[i] = pts[i][X];
+		py[i] = pts[i][Y];
+		pz[i] = pts[i][Z];
+	}
+
+	if (native)
+	{
+		for (std::size_t i = 0; i < leaves.size(); ++i)
+			leaves[i]->values(pts, slots + i * blockSize, n);
+		native(px, py, pz, slots, out, n, &Structure<T>::dampValue);
+		return;
+	}
+
+	for (typename std::vector<Instruction>::const_iterator
+	     instruction = instructions.begin();
+	     instruction != instructions.end(); ++instruction)
+	{
+		T * const s = slots + instruction->slot * blockSize;
+		const T * const q = parameters.empty() ? 0 : &parameters[0] + instruction->index;
+
+		switch (instruction->op)
+		{
+			case Instruction::LEAF:
+				leaves[instruction->index]->values(pts, s, n);
+				break;
+
+			case Instruction::SPHERE:
+			{
+				T distSq[Structure<T>::blockSize];
+				Sphere<T>::distancesSq(px, py, pz, n, q + CENTER,
+					reinterpret_cast<const T (*)[3]>(q + TRANSFORM), distSq);
+				SphericStructure<T>::sphereValues(distSq, s, n,
+						q[EXPONENT], q[RADIUS]);
+				break;
+			}
+
+			case Instruction::CLEAR:
+				std::fill(s, s + n, T(0.0));
+				break;
+
+			case Instruction::ACCUMULATE:
+			{
+				const T * const source = slots + instruction->source * blockSize;
+				const Power<T> power(q[0]);
+				for (std::size_t i = 0; i < n; ++i)
+					s[i] += power(source[i]);
+				break;
+			}
+
+			case Instruction::FINISH:
+			{
+				const Power<T> power(q[0]);
+				for (std::size_t i = 0; i < n; ++i)
+					s[i] = power(s[i]);
+				break;
+			}
+
+			case Instruction::DAMPING:
+				for (std::size_t i = 0; i < n; ++i)
+					s[i] = Structure<T>::dampValue(s[i], q[0], q[1]);
+				break;
+
+			default: assert(false);
+		}
+	}
+
+	std::copy(slots, slots + n, out);
+}
+
+template <typename T>
+void CompiledShape<T>::values(const FPPoint * const pts, T * const out,
+			      const std::size_t n) const
+{
+	if (this->empty())
+	{
+		std::fill(out, out + n, T(0.0));
+		return;
+	}
+
+	const std::size_t blockSize = Structure<T>::blockSize;
+	std::vector<T> slots(this->buffers() * blockSize);
+	for (std::size_t i = 0; i < n; i += blockSize)
+		this->run(pts + i, out + i, std::min(blockSize, n - i), &slots[0]);
+}
+
+template <typename T>
+void CompiledShape<T>::values(const FPPoint &first, const FPVector &step,
+			      T * const out, const std::size_t n) const
+{
+	if (this->empty())
+	{
+		std::fill(out, out + n, T(0.0));
+		return;
+	}
+
+	const std::size_t blockSize = Structure<T>::blockSize;
+	std::vector<T> slots(this->buffers() * blockSize);
+	FPPoint pts[Structure<T>::blockSize];
+	for (std::size_t i = 0; i < n; i += blockSize)
+	{
+		const std::size_t m = std::min(blockSize, n - i);
+		for (std::size_t j = 0; j < m; ++j)
+			pts[j] = first + step * T(i + j);
+		this->run(pts, out + i, m, &slots[0]);
+	}
+}
+
+template <typename T>
+void CompiledShape<T>::writeSource(std::ostream &os) const
+{
+	using detail::nativeLiteral;
+	const std::size_t blockSize = Structure<T>::blockSize;
+
+	os <<	"// Generated by shapes::CompiledShape\n"
+		"#include <cmath>\n"
+		"#include <limits>\n\n"
+		"typedef " << detail::NativeType<T>::name() << " T;\n\n"
+		// Same as SphericStructure<T>::capped()
+		"static T S(const T x) { return x*x*x*(1-x/2); }\n\n"
+		"static T s(const T x, const T gamma, const T delta)\n"
+		"{ return x -  2*delta*S( (x - gamma+delta)/(2*delta) ); }\n\n"
+		"static T capped(const T val_inv)\n"
+		"{\n"
+		"\tconst T gamma = std::numeric_limits<T>::max() / 2.;\n"
+		"\tconst T delta = gamma / std::pow(T(2), T(std::numeric_limits<T>::digits));\n"
+		"\treturn   (val_inv >= 1/(gamma-delta)) ?   1/val_inv :\n"
+		"\t\t((val_inv >= 1/(gamma+delta)) ? s(1/val_inv, gamma, delta) : gamma);\n"
+		"}\n\n"
+		"extern \"C\" void shapes_native_values(const T *px, const T *py, const T *pz,\n"
+		"\tconst T *leaves, T *out, const unsigned long n, T (*damp)(T, T, T))\n"
+		"{\n"
+		"\tfor (unsigned long i = 0; i < n; ++i)\n"
+		"\t{\n"
+		"\t\tconst T x = px[i], y = py[i], z = pz[i];\n";
+
+	for (unsigned slot = 0; slot < slots_; ++slot)
+		os << "\t\tT v" << slot << " = 0;\n";
+
+	for (typename std::vector<Instruction>::const_iterator
+	     instruction = instructions.begin();
+	     instruction != instructions.end(); ++instruction)
+	{
+		const T * const q = parameters.empty() ? 0 : &parameters[0] + instruction->index;
+		const unsigned slot = instruction->slot;
+
+		switch (instruction->op)
+		{
+			case Instruction::LEAF:
+				os << "\t\tv" << slot << " = leaves[" <<
+					instruction->index * blockSize << " + i];\n";
+				break;
+
+			case Instruction::SPHERE:
+				os << "\t\t{\n"
+				   << "\t\t\tconst T dx = x - " << nativeLiteral(q[CENTER+X]) << ";\n"
+				   << "\t\t\tconst T dy = y - " << nativeLiteral(q[CENTER+Y]) << ";\n"
+				   << "\t\t\tconst T dz = z - " << nativeLiteral(q[CENTER+Z]) << ";\n";
+				for (unsigned i = 0; i < 3; ++i)
+				{
+					const T * const m = q + TRANSFORM + 3*i;
+					const char * const d[] = { "dx", "dy", "dz" };
+					os << "\t\t\tconst T t" << i << " = ";
+					// Unit rows of unrotated spheres with unit weights
+					if (m[i] == T(1) && m[(i+1)%3] == T(0) && m[(i+2)%3] == T(0))
+						os << d[i] << ";\n";
+					else
+						os << "dx*" << nativeLiteral(m[X]) << " + "
+						   << "dy*" << nativeLiteral(m[Y]) << " + "
+						   << "dz*" << nativeLiteral(m[Z]) << ";\n";
+				}
+				os << "\t\t\tv" << slot << " = capped( std::pow( (t0*t0+t1*t1+t2*t2) / "
+				   << nativeLiteral(q[RADIUS]*q[RADIUS]) << ", "
+				   << nativeLiteral(q[EXPONENT] * T(0.5)) << ") );\n"
+				   << "\t\t}\n";
+				break;
+
+			case Instruction::CLEAR:
+				os << "\t\tv" << slot << " = 0;\n";
+				break;
+
+			case Instruction::ACCUMULATE:
+				os << "\t\tv" << slot << " += std::pow(v" << instruction->source
+				   << ", " << nativeLiteral(q[0]) << ");\n";
+				break;
+
+			case Instruction::FINISH:
+				os << "\t\tv" << slot << " = std::pow(v" << slot
+				   << ", " << nativeLiteral(q[0]) << ");\n";
+				break;
+
+			case Instruction::DAMPING:
+				os << "\t\tv" << slot << " = damp(v" << slot << ", "
+				   << nativeLiteral(q[0]) << ", " << nativeLiteral(q[1]) << ");\n";
+				break;
+
+			default: assert(false);
+		}
+	}
+
+	os <<	"\t\tout[i] = v0;\n"
+		"\t}\n"
+		"}\n";
+}
+
+template <typename T>
+bool CompiledShape<T>::compileNative(std::string cacheDir)
+{
+#ifdef SHAPES_HAVE_DLOPEN
+	if (this->empty())
+		return false;
+
+	if (cacheDir.empty())
+		cacheDir = detail::nativeCacheDir();
+	if (cacheDir.empty() || !detail::nativeMakeDir(cacheDir))
+	{
+		std::cout << "CompiledShape: cache directory [" << cacheDir << "] must be "
+			  << "owned by the user and not writable by others." << std::endl;
+		return false;
+	}
+
+	std::ostringstream source;
+	this->writeSource(source);
+	const std::string code = source.str();
+
+	// The compiler and its options, split on white space as by a shell,
+	// but without any other interpretation.
+	const char * const cxx = std::getenv("CXX");
+	std::vector<std::string> command;
+	std::istringstream words(cxx ? cxx : "c++");
+	std::copy(std::istream_iterator<std::string>(words),
+		  std::istream_iterator<std::string>(), std::back_inserter(command));
+	if (command.empty())
+		command.push_back("c++");
+	command.push_back("-O2");
+	command.push_back("-fPIC");
+	command.push_back("-shared");
+
+	std::string signature;
+	for (std::size_t i = 0; i < command.size(); ++i)
+		signature += command[i] + " ";
+
+	std::ostringstream name;
+	name << cacheDir << "/shapes-native-" << std::hex << detail::nativeHash(signature + code);
+	const std::string sourceFile  = name.str() + ".cc";
+	const std::string libraryFile = name.str() + ".so";
+
+	if (!detail::nativeCached(sourceFile, libraryFile, code))
+	{
+		// Build under fresh temporary names, so that other processes
+		// never load an incomplete library.
+		std::string tmpSource, tmpLibrary;
+		if (!detail::nativeTempFile(name.str(), tmpSource))
+		{
+			std::cout << "CompiledShape: can't write to [" << cacheDir << "]." << std::endl;
+			return false;
+		}
+		if (!detail::nativeTempFile(name.str(), tmpLibrary))
+		{
+			std::cout << "CompiledShape: can't write to [" << cacheDir << "]." << std::endl;
+			std::remove(tmpSource.c_str());
+			return false;
+		}
+
+		std::ofstream out(tmpSource.c_str());
+		out << code;
+		out.close();
+		if (!out)
+		{
+			std::cout << "CompiledShape: can't write [" << tmpSource << "]." << std::endl;
+			std::remove(tmpSource.c_str());
+			std::remove(tmpLibrary.c_str());
+			return false;
+		}
+
+		command.push_back("-o");
+		command.push_back(tmpLibrary);
+		command.push_back("-x");
+		command.push_back("c++");
+		command.push_back(tmpSource);
+		if (!detail::nativeRun(command) ||
+		    chmod(tmpLibrary.c_str(), S_IRWXU) != 0)
+		{
+			std::cout << "CompiledShape: [" << signature << "-o " << tmpLibrary
+				  << " -x c++ " << tmpSource << "] failed." << std::endl;
+			std::remove(tmpSource.c_str());
+			std::remove(tmpLibrary.c_str());
+			return false;
+		}
+
+		// The source goes last: it marks the library as complete.
+		if (std::rename(tmpLibrary.c_str(), libraryFile.c_str()) != 0 ||
+		    std::rename(tmpSource.c_str(),  sourceFile.c_str())  != 0)
+		{
+			std::cout << "CompiledShape: can't write to [" << cacheDir << "]." << std::endl;
+			std::remove(tmpSource.c_str());
+			std::remove(tmpLibrary.c_str());
+			return false;
+		}
+	}
+
+	void * const handle = dlopen(libraryFile.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (handle == NULL)
+	{
+		std::cout << "CompiledShape: " << dlerror() << std::endl;
+		return false;
+	}
+
+	// POSIX allows converting the result of dlsym() to a function pointer
+	union { void *symbol; NativeFunction function; } entry;
+	entry.symbol = dlsym(handle, "shapes_native_values");
+	if (entry.symbol == NULL)
+	{
+		std::cout << "CompiledShape: " << dlerror() << std::endl;
+		dlclose(handle);
+		return false;
+	}
+
+	library = std::tr1::shared_ptr<void>(handle, dlclose);
+	native  = entry.function;
+
+	return true;
+#else
+	std::cout << "CompiledShape: native code is not supported on this platform." << std::endl;
+	return false;
+#endif
+}
+
+} // end namespace
@@ -0,0 +1,474 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_COMPOSE_H
+#define SHAPES_COMPOSE_H 1
+
+#include <cmath>
+#include <cassert>
+
+#include <shapes/Sphere.h>
+#include <shapes/Tube.h>
+#include <shapes/Union.h>
+#include <shapes/Intersection.h>
+#include <shapes/Difference.h>
+#include <shapes/Shape.h>
+
+namespace shapes
+{
+
+/*
+ * Shapes composed at compile time, for shapes that are built in code, never
+ * change, and are evaluated very often. The exponents of the combinations and
+ * the number of children are template parameters, all calls are inlined:
+ *
+ *	Sphere<double> a(...), b(...);
+ *	Tube<double>   t(...);
+ *
+ *	const UnionTerm<4, SphereTerm<double>, TubeTerm<double> > u =
+ *		makeUnion<4>(a, t);
+ *	const DifferenceTerm<2, UnionTerm<4, SphereTerm<double>,
+ *		TubeTerm<double> >, SphereTerm<double> > d = makeDifference<2>(u, b);
+ *
+ *	const double v = d.value(p);
+ *
+ * Unions and Intersections take 2 to 4 children, Differences one positive
+ * and 1 to 3 negative children; deeper trees are built by nesting. Spheres
+ * and Tubes keep their own damping; composed terms are not damped. Results
+ * agree with the runtime Structures up to rounding, as integer powers are
+ * computed by multiplication.
+ *
+ * toStructure() converts a term to a new runtime Structure, e.g. to add it
+ * to a Shape<T> for export.
+ */
+
+// Placeholder for unused children
+struct NoTerm { };
+
+namespace detail
+{
+
+// x^N for integer N
+template <int N, bool Negative = (N < 0)>
+struct IntPow
+{
+	template <typename T>
+	static T eval(const T x)
+	{
+		const T h = IntPow<N/2>::eval(x);
+		return (N % 2) ? h*h*x : h*h;
+	}
+};
+
+template <int N>
+struct IntPow<N, true>
+{
+	template <typename T>
+	static T eval(const T x) { return T(1) / IntPow<-N>::eval(x); }
+};
+
+template <>
+struct IntPow<0, false>
+{
+	template <typename T>
+	static T eval(const T) { return T(1); }
+};
+
+template <>
+struct IntPow<1, false>
+{
+	template <typename T>
+	static T eval(const T x) { return x; }
+};
+
+// x^(1/N) for N > 0
+template <int N>
+struct Root
+{
+	template <typename T>
+	static T eval(const T x) { return std::pow(x, T(1) / T(N)); }
+};
+
+template <>
+struct Root<1>
+{
+	template <typename T>
+	static T eval(const T x) { return x; }
+};
+
+template <>
+struct Root<2>
+{
+	template <typename T>
+	static T eval(const T x) { return std::sqrt(x); }
+};
+
+template <>
+struct Root<4>
+{
+	template <typename T>
+	static T eval(const T x) { return std::sqrt(std::sqrt(x)); }
+};
+
+// x^(E/2); E == 0 means the exponent e is only known at runtime.
+template <int E, int Kind = (E == 0) ? 0 : ((E % 2) ? 1 : 2)>
+struct HalfPow
+{
+	template <typename T>
+	static T eval(const T x, const T e) { return std::pow(x, e * T(0.5)); }
+};
+
+template <int E>
+struct HalfPow<E, 1>
+{
+	template <typename T>
+	static T eval(const T x, const T) { return IntPow<E>::eval(std::sqrt(x)); }
+};
+
+template <int E>
+struct HalfPow<E, 2>
+{
+	template <typename T>
+	static T eval(const T x, const T) { return IntPow<E/2>::eval(x); }
+};
+
+// Compile-time check that exponents are positive
+template <bool> struct PositiveExponent;
+template <> struct PositiveExponent<true> { };
+
+// Children of a combination: term^E, zero for unused children
+template <int E, typename T, typename Term>
+struct Child
+{
+	static T power(const Term &term, const typename EuclidTypes<T>::FPPoint &p)
+	{ return IntPow<E>::eval(term.value(p)); }
+
+	static Structure<T> *toStructure(const Term &term)
+	{ return term.toStructure(); }
+};
+
+template <int E, typename T>
+struct Child<E, T, NoTerm>
+{
+	static T power(const NoTerm &, const typename EuclidTypes<T>::FPPoint &)
+	{ return T(0); }
+
+	static Structure<T> *toStructure(const NoTerm &) { return 0; }
+};
+
+} // end namespace detail
+
+// Type of the term for a Sphere, a Tube, or a term
+template <typename X>
+struct TermOf { typedef X type; };
+
+template <typename T, int E = 0>
+class SphereTerm;
+
+template <typename T>
+class TubeTerm;
+
+template <typename T>
+struct TermOf<Sphere<T> > { typedef SphereTerm<T> type; };
+
+template <typename T>
+struct TermOf<Tube<T> > { typedef TubeTerm<T> type; };
+
+// Evaluation of many points, for all terms
+template <typename Derived, typename T>
+class Term
+{
+	public:
+		typedef T value_type;
+		typedef typename EuclidTypes<T>::FPPoint  FPPoint;
+		typedef typename EuclidTypes<T>::FPVector FPVector;
+
+		void values(const FPPoint * const pts, T * const out,
+			    const std::size_t n) const
+		{
+			const Derived &derived = static_cast<const Derived &>(*this);
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = derived.value(pts[i]);
+		}
+
+		// Evaluate n points on a grid row: first, first + step, ...
+		void values(const FPPoint &first, const FPVector &step,
+			    T * const out, const std::size_t n) const
+		{
+			const Derived &derived = static_cast<const Derived &>(*this);
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = derived.value(first + step * T(i));
+		}
+};
+
+// A Sphere; if E is not zero, the exponent of the sphere must equal E.
+template <typename T, int E>
+class SphereTerm : public Term<SphereTerm<T, E>, T>
+{
+	public:
+		typedef typename Term<SphereTerm<T, E>, T>::FPPoint FPPoint;
+
+		SphereTerm(const Sphere<T> &sphere) :
+			sphere_(sphere), r(sphere.getRadius()), e(sphere.getExponent()),
+			dampLow(sphere.getDampLow()), dampHigh(sphere.getDampHigh())
+		{
+			assert(E == 0 || T(E) == e);
+			for (unsigned i = 0; i < 3; ++i)
+				c[i] = sphere.getCenter(i);
+			sphere.getTransform(m);
+			damped = (dampLow != T(1.0) || dampHigh != T(1.0));
+		}
+
+		T value(const FPPoint &p) const
+		{
+			const T cp[3] = { p[X] - c[X], p[Y] - c[Y], p[Z] - c[Z] };
+			const T x = cp[X]*m[X][X] + cp[Y]*m[X][Y] + cp[Z]*m[X][Z];
+			const T y = cp[X]*m[Y][X] + cp[Y]*m[Y][Y] + cp[Z]*m[Y][Z];
+			const T z = cp[X]*m[Z][X] + cp[Y]*m[Z][Y] + cp[Z]*m[Z][Z];
+			const T distSq = x*x+y*y+z*z;
+
+			const T v = SphericStructure<T>::capped(
+					detail::HalfPow<E>::eval(distSq/(r*r), e) );
+
+			return damped ? Structure<T>::dampValue(v, dampLow, dampHigh) : v;
+		}
+
+		Structure<T> *toStructure() const { return new Sphere<T>(sphere_); }
+
+	private:
+		Sphere<T> sphere_;
+		T c[3], m[3][3], r, e, dampLow, dampHigh;
+		bool damped;
+};
+
+// A Tube, called without virtual functions
+template <typename T>
+class TubeTerm : public Term<TubeTerm<T>, T>
+{
+	public:
+		typedef typename Term<TubeTerm<T>, T>::FPPoint FPPoint;
+
+		TubeTerm(const Tube<T> &tube) : tube_(tube) { }
+
+		T value(const FPPoint &p) const { return tube_.value(p); }
+
+		Structure<T> *toStructure() const { return new Tube<T>(tube_); }
+
+	private:
+		Tube<T> tube_;
+};
+
+// (a^E + b^E + ...)^(1/E), as Union<T>
+template <int E, typename A, typename B, typename C = NoTerm, typename D = NoTerm>
+class UnionTerm : public Term<UnionTerm<E, A, B, C, D>, typename A::value_type>,
+		  private detail::PositiveExponent<(E > 0)>
+{
+	public:
+		typedef typename A::value_type T;
+		typedef typename Term<UnionTerm<E, A, B, C, D>, T>::FPPoint FPPoint;
+
+		UnionTerm(const A &_a, const B &_b, const C &_c = C(), const D &_d = D()) :
+			a(_a), b(_b), c(_c), d(_d) { }
+
+		T value(const FPPoint &p) const
+		{
+			return detail::Root<E>::eval(
+				detail::Child<E, T, A>::power(a, p) + detail::Child<E, T, B>::power(b, p) +
+				detail::Child<E, T, C>::power(c, p) + detail::Child<E, T, D>::power(d, p) );
+		}
+
+		Structure<T> *toStructure() const
+		{
+			Union<T> * const u = new Union<T>(T(E));
+			Structure<T> * const children[4] = {
+				detail::Child<E, T, A>::toStructure(a), detail::Child<E, T, B>::toStructure(b),
+				detail::Child<E, T, C>::toStructure(c), detail::Child<E, T, D>::toStructure(d) };
+			for (unsigned i = 0; i < 4; ++i)
+				if (children[i])
+					u->add(children[i]);
+			return u;
+		}
+
+	private:
+		A a; B b; C c; D d;
+};
+
+// (a^-E + b^-E + ...)^(-1/E), as Intersection<T>
+template <int E, typename A, typename B, typename C = NoTerm, typename D = NoTerm>
+class IntersectionTerm : public Term<IntersectionTerm<E, A, B, C, D>, typename A::value_type>,
+			 private detail::PositiveExponent<(E > 0)>
+{
+	public:
+		typedef typename A::value_type T;
+		typedef typename Term<IntersectionTerm<E, A, B, C, D>, T>::FPPoint FPPoint;
+
+		IntersectionTerm(const A &_a, const B &_b, const C &_c = C(), const D &_d = D()) :
+			a(_a), b(_b), c(_c), d(_d) { }
+
+		T value(const FPPoint &p) const
+		{
+			return T(1) / detail::Root<E>::eval(
+				detail::Child<-E, T, A>::power(a, p) + detail::Child<-E, T, B>::power(b, p) +
+				detail::Child<-E, T, C>::power(c, p) + detail::Child<-E, T, D>::power(d, p) );
+		}
+
+		Structure<T> *toStructure() const
+		{
+			Intersection<T> * const s = new Intersection<T>(T(E));
+			Structure<T> * const children[4] = {
+				detail::Child<E, T, A>::toStructure(a), detail::Child<E, T, B>::toStructure(b),
+				detail::Child<E, T, C>::toStructure(c), detail::Child<E, T, D>::toStructure(d) };
+			for (unsigned i = 0; i < 4; ++i)
+				if (children[i])
+					s->add(children[i]);
+			return s;
+		}
+
+	private:
+		A a; B b; C c; D d;
+};
+
+// (p^-E + n0^E + n1^E + ...)^(-1/E), as Difference<T> with positive child
+// p and negative children n0, n1, ...
+template <int E, typename P, typename N0, typename N1 = NoTerm, typename N2 = NoTerm>
+class DifferenceTerm : public Term<DifferenceTerm<E, P, N0, N1, N2>, typename P::value_type>,
+		       private detail::PositiveExponent<(E > 0)>
+{
+	public:
+		typedef typename P::value_type T;
+		typedef typename Term<DifferenceTerm<E, P, N0, N1, N2>, T>::FPPoint FPPoint;
+
+		DifferenceTerm(const P &_p, const N0 &_n0, const N1 &_n1 = N1(), const N2 &_n2 = N2()) :
+			pos(_p), n0(_n0), n1(_n1), n2(_n2) { }
+
+		T value(const FPPoint &p) const
+		{
+			return T(1) / detail::Root<E>::eval(
+				detail::Child<-E, T, P>::power(pos, p) + detail::Child<E, T, N0>::power(n0, p) +
+				detail::Child<E, T, N1>::power(n1, p) + detail::Child<E, T, N2>::power(n2, p) );
+		}
+
+		Structure<T> *toStructure() const
+		{
+			Difference<T> * const s = new Difference<T>(T(E));
+			s->addPositive(pos.toStructure());
+			Structure<T> * const negatives[3] = { detail::Child<E, T, N0>::toStructure(n0),
+				detail::Child<E, T, N1>::toStructure(n1), detail::Child<E, T, N2>::toStructure(n2) };
+			for (unsigned i = 0; i < 3; ++i)
+				if (negatives[i])
+					s->addNegative(negatives[i]);
+			return s;
+		}
+
+	private:
+		P pos; N0 n0; N1 n1; N2 n2;
+};
+
+/*
+ * Builders; Spheres and Tubes may be passed directly.
+ */
+
+// Sphere with exponent E known at compile time
+template <int E, typename T>
+SphereTerm<T, E> makeSphere(const Sphere<T> &sphere)
+{ return SphereTerm<T, E>(sphere); }
+
+template <int E, typename A, typename B>
+UnionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type>
+makeUnion(const A &a, const B &b)
+{
+	return UnionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type>(a, b);
+}
+
+template <int E, typename A, typename B, typename C>
+UnionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type, typename TermOf<C>::type>
+makeUnion(const A &a, const B &b, const C &c)
+{
+	return UnionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type,
+			typename TermOf<C>::type>(a, b, c);
+}
+
+template <int E, typename A, typename B, typename C, typename D>
+UnionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type,
+	typename TermOf<C>::type, typename TermOf<D>::type>
+makeUnion(const A &a, const B &b, const C &c, const D &d)
+{
+	return UnionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type,
+			typename TermOf<C>::type, typename TermOf<D>::type>(a, b, c, d);
+}
+
+template <int E, typename A, typename B>
+IntersectionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type>
+makeIntersection(const A &a, const B &b)
+{
+	return IntersectionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type>(a, b);
+}
+
+template <int E, typename A, typename B, typename C>
+IntersectionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type, typename TermOf<C>::type>
+makeIntersection(const A &a, const B &b, const C &c)
+{
+	return IntersectionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type,
+			typename TermOf<C>::type>(a, b, c);
+}
+
+template <int E, typename A, typename B, typename C, typename D>
+IntersectionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type,
+	typename TermOf<C>::type, typename TermOf<D>::type>
+makeIntersection(const A &a, const B &b, const C &c, const D &d)
+{
+	return IntersectionTerm<E, typename TermOf<A>::type, typename TermOf<B>::type,
+			typename TermOf<C>::type, typename TermOf<D>::type>(a, b, c, d);
+}
+
+template <int E, typename P, typename N0>
+DifferenceTerm<E, typename TermOf<P>::type, typename TermOf<N0>::type>
+makeDifference(const P &p, const N0 &n0)
+{
+	return DifferenceTerm<E, typename TermOf<P>::type, typename TermOf<N0>::type>(p, n0);
+}
+
+template <int E, typename P, typename N0, typename N1>
+DifferenceTerm<E, typename TermOf<P>::type, typename TermOf<N0>::type, typename TermOf<N1>::type>
+makeDifference(const P &p, const N0 &n0, const N1 &n1)
+{
+	return DifferenceTerm<E, typename TermOf<P>::type, typename TermOf<N0>::type,
+			typename TermOf<N1>::type>(p, n0, n1);
+}
+
+template <int E, typename P, typename N0, typename N1, typename N2>
+DifferenceTerm<E, typename TermOf<P>::type, typename TermOf<N0>::type,
+	typename TermOf<N1>::type, typename TermOf<N2>::type>
+makeDifference(const P &p, const N0 &n0, const N1 &n1, const N2 &n2)
+{
+	return DifferenceTerm<E, typename TermOf<P>::type, typename TermOf<N0>::type,
+			typename TermOf<N1>::type, typename TermOf<N2>::type>(p, n0, n1, n2);
+}
+
+// Add a new runtime Structure for the term to the shape
+template <typename Derived, typename T>
+void addToShape(const Term<Derived, T> &term, Shape<T> &shape)
+{
+	shape.add(static_cast<const Derived &>(term).toStructure());
+}
+
+} // end namespace
+
+#endif
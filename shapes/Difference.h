@@ -23,6 +23,7 @@
 
 #include <vector>
 #include <shapes/Structure.h>
+#include <shapes/Power.h>
 
 namespace shapes
 {
@@ -35,10 +36,12 @@ class Difference : public Structure<T>
 		typedef typename Structure<T>::FPVector FPVector;
 
 		Difference(const std::string name__ = "", T _exponent = 2.) :
-			Structure<T>(name__), exponent(_exponent) { }
+			Structure<T>(name__), exponent(_exponent)
+		{ this->setPowers(); }
 
 		Difference(T _exponent, const std::string name__ = "") :
-			Structure<T>(name__), exponent(_exponent) { }
+			Structure<T>(name__), exponent(_exponent)
+		{ this->setPowers(); }
 
 		virtual ~Difference();
 
@@ -69,8 +72,15 @@ class Difference : public Structure<T>
 			}
 		}
 
+		// The overlap of the supports of the positive structures that have one
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
 		virtual void print(unsigned int indent) const;
 
+		virtual void compile(CompiledShape<T> &compiled, const unsigned slot) const;
+
+		virtual T cost() const;
+
 		void addPositive(Structure<T> *structure);
 		void addNegative(Structure<T> *structure);
 
@@ -83,11 +93,28 @@ class Difference : public Structure<T>
 
 	private:
 		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
+		virtual void rawInside(const FPPoint * const pts, bool * const out,
+				       const std::size_t n) const;
 		unsigned sectionFromXML(TiXmlHandle root, std::vector<Structure<T> *> &structures);
 
 		std::vector<Structure<T> *> positiveStructures;
 		std::vector<Structure<T> *> negativeStructures;
+
+		// Pairs of cost and index of the structures, cheapest first
+		std::vector<std::pair<T, std::size_t> > positiveOrder, negativeOrder;
 		T exponent;
+
+		// x^-exponent, x^exponent and x^(-1/exponent)
+		Power<T> positivePower, negativePower, root;
+
+		void setPowers()
+		{
+			positivePower.set(-exponent);
+			negativePower.set(exponent);
+			root.set(T(-1) / exponent);
+		}
 };
 
 } // end namespace
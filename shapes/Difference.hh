@@ -24,9 +24,13 @@
 #include <boost/lexical_cast.hpp>
 
 #include <shapes/Sphere.h>
+#include <shapes/SphereCloud.h>
+#include <shapes/Repeat.h>
+#include <shapes/Instance.h>
 #include <shapes/Tube.h>
 #include <shapes/Union.h>
 #include <shapes/Intersection.h>
+#include <shapes/CompiledShape.h>
 
 namespace shapes
 {
@@ -50,6 +54,8 @@ void Difference<T>::clear()
 
 	positiveStructures.clear();
 	negativeStructures.clear();
+	positiveOrder.clear();
+	negativeOrder.clear();
 	this->setName("");
 }
 
@@ -57,12 +63,20 @@ template <typename T>
 void Difference<T>::addPositive(Structure<T> *structure)
 {
 	positiveStructures.push_back(structure);
+	const std::pair<T, std::size_t> entry(structure->cost(),
+					      positiveStructures.size() - 1u);
+	positiveOrder.insert(std::upper_bound(positiveOrder.begin(),
+					      positiveOrder.end(), entry), entry);
 }
 
 template <typename T>
 void Difference<T>::addNegative(Structure<T> *structure)
 {
 	negativeStructures.push_back(structure);
+	const std::pair<T, std::size_t> entry(structure->cost(),
+					      negativeStructures.size() - 1u);
+	negativeOrder.insert(std::upper_bound(negativeOrder.begin(),
+					      negativeOrder.end(), entry), entry);
 }
 
 template <typename T>
@@ -73,14 +87,166 @@ T Difference<T>::rawValue(const FPPoint &p) const
 	for (typename std::vector<Structure<T> *>::const_iterator
 	     i = positiveStructures.begin();
 	     i != positiveStructures.end(); ++i)
-		val += pow( (*i)->value(p), -exponent );
+		val += positivePower( (*i)->value(p) );
 
 	for (typename std::vector<Structure<T> *>::const_iterator
 	     i = negativeStructures.begin();
 	     i != negativeStructures.end(); ++i)
-		val += pow( (*i)->value(p), exponent );
+		val += negativePower( (*i)->value(p) );
 
-	return pow(val, T(-1)/exponent );
+	return root(val);
+}
+
+template <typename T>
+void Difference<T>::rawValues(const FPPoint * const pts, T * const out,
+			      const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+	T childValues[Structure<T>::blockSize];
+
+	std::fill(out, out + n, T(0.0));
+	for (typename std::vector<Structure<T> *>::const_iterator
+	     i = positiveStructures.begin();
+	     i != positiveStructures.end(); ++i)
+	{
+		(*i)->values(pts, childValues, n);
+		for (std::size_t j = 0; j < n; ++j)
+			out[j] += positivePower(childValues[j]);
+	}
+
+	for (typename std::vector<Structure<T> *>::const_iterator
+	     i = negativeStructures.begin();
+	     i != negativeStructures.end(); ++i)
+	{
+		(*i)->values(pts, childValues, n);
+		for (std::size_t j = 0; j < n; ++j)
+			out[j] += negativePower(childValues[j]);
+	}
+
+	for (std::size_t j = 0; j < n; ++j)
+		out[j] = root(out[j]);
+}
+
+template <typename T>
+bool Difference<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	// A vanishing structure makes the sum of powers infinite, and
+	// the difference zero, provided that the exponent is positive.
+	if (!(exponent > T(0)))
+		return false;
+
+	bool found = false;
+	lower = -std::numeric_limits<T>::max();
+	upper =  std::numeric_limits<T>::max();
+	for (typename std::vector<Structure<T> *>::const_iterator i = positiveStructures.begin();
+	     i != positiveStructures.end(); ++i)
+	{
+		FPPoint l, u;
+		if (!(*i)->getSupport(l, u))
+			continue;
+		found = true;
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::max(lower[d], l[d]);
+			upper[d] = std::min(upper[d], u[d]);
+		}
+	}
+
+	return found;
+}
+
+template <typename T>
+T Difference<T>::cost() const
+{
+	T c = 1;
+	for (typename std::vector<Structure<T> *>::const_iterator i = positiveStructures.begin();
+	     i != positiveStructures.end(); ++i)
+		c += (*i)->cost();
+	for (typename std::vector<Structure<T> *>::const_iterator i = negativeStructures.begin();
+	     i != negativeStructures.end(); ++i)
+		c += (*i)->cost();
+
+	return c;
+}
+
+template <typename T>
+void Difference<T>::rawInside(const FPPoint * const pts, bool * const out,
+			      const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+
+	// Points not yet decided, their index in the block, and the sum
+	// for each so far
+	FPPoint rest[Structure<T>::blockSize];
+	std::size_t index[Structure<T>::blockSize];
+	T sums[Structure<T>::blockSize];
+	T childValues[Structure<T>::blockSize];
+	std::size_t m = n;
+	for (std::size_t j = 0; j < n; ++j)
+	{
+		rest[j]  = pts[j];
+		index[j] = j;
+		sums[j]  = 0;
+	}
+
+	// The difference is at most as large as each positive child, and
+	// as the inverse of each negative one.
+	std::size_t positive = 0, negative = 0;
+	while (m > 0u && (positive < positiveOrder.size() || negative < negativeOrder.size()))
+	{
+		// Cheapest next
+		const bool isNegative = (positive == positiveOrder.size()) ||
+			( (negative < negativeOrder.size()) &&
+			  (negativeOrder[negative].first < positiveOrder[positive].first) );
+		if (isNegative)
+			negativeStructures[negativeOrder[negative++].second]->values(rest, childValues, m);
+		else
+			positiveStructures[positiveOrder[positive++].second]->values(rest, childValues, m);
+
+		std::size_t kept = 0;
+		for (std::size_t j = 0; j < m; ++j)
+		{
+			if (isNegative ? (childValues[j] > T(1)) : (childValues[j] < T(1)))
+			{
+				out[index[j]] = false;
+				continue;
+			}
+			rest[kept]  = rest[j];
+			index[kept] = index[j];
+			sums[kept]  = sums[j] + (isNegative ? negativePower(childValues[j]) :
+							      positivePower(childValues[j]));
+			++kept;
+		}
+		m = kept;
+	}
+
+	for (std::size_t j = 0; j < m; ++j)
+		out[index[j]] = root(sums[j]) >= T(1);
+}
+
+template <typename T>
+void Difference<T>::compile(CompiledShape<T> &compiled, const unsigned slot) const
+{
+	compiled.emitClear(slot);
+
+	for (typename std::vector<Structure<T> *>::const_iterator
+	     i = positiveStructures.begin();
+	     i != positiveStructures.end(); ++i)
+	{
+		(*i)->compile(compiled, slot + 1);
+		compiled.emitAccumulate(slot, slot + 1, -exponent);
+	}
+
+	for (typename std::vector<Structure<T> *>::const_iterator
+	     i = negativeStructures.begin();
+	     i != negativeStructures.end(); ++i)
+	{
+		(*i)->compile(compiled, slot + 1);
+		compiled.emitAccumulate(slot, slot + 1, exponent);
+	}
+
+	compiled.emitFinish(slot, T(-1) / exponent);
+	this->compileDamping(compiled, slot);
 }
 
 template <typename T>
@@ -106,6 +272,63 @@ unsigned Difference<T>::sectionFromXML(TiXmlHandle root, std::vector<Structure<T
 		structures.push_back(sphere);
 	}
 
+	unsigned sphereClouds = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("SphereCloud").ToElement();
+	     elem; elem = elem->NextSiblingElement("SphereCloud") )
+	{
+		++sphereClouds;
+		SphereCloud<T> * cloud = new SphereCloud<T>();
+		TiXmlHandle	handle(elem);
+		if (!cloud->fromXML(handle))
+		{
+			std::cout << "Difference"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure SphereCloud "
+				<< sphereClouds << "." << std::endl;
+			return false;
+		}
+
+		structures.push_back(cloud);
+	}
+
+	unsigned repeats = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Repeat").ToElement();
+	     elem; elem = elem->NextSiblingElement("Repeat") )
+	{
+		++repeats;
+		Repeat<T> * repeat = new Repeat<T>();
+		TiXmlHandle	handle(elem);
+		if (!repeat->fromXML(handle))
+		{
+			std::cout << "Difference"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure Repeat "
+				<< repeats << "." << std::endl;
+			return false;
+		}
+
+		structures.push_back(repeat);
+	}
+
+	unsigned instances = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Instance").ToElement();
+	     elem; elem = elem->NextSiblingElement("Instance") )
+	{
+		++instances;
+		Instance<T> * instance = new Instance<T>();
+		TiXmlHandle	handle(elem);
+		if (!instance->fromXML(handle))
+		{
+			std::cout << "Difference"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure Instance "
+				<< instances << "." << std::endl;
+			return false;
+		}
+
+		structures.push_back(instance);
+	}
+
 	unsigned tubes = 0;
 	for (TiXmlElement * elem = root.FirstChildElement("Tube").ToElement();
 	     elem; elem = elem->NextSiblingElement("Tube") )
@@ -205,6 +428,7 @@ bool Difference<T>::fromXML(TiXmlHandle &root)
 			<< ": Exponent parse failure, Exponent not greater than zero." << std::endl;
 		return false;
 	}
+	this->setPowers();
 
 	if ( (elem = root.FirstChildElement("DampLow").ToElement()) )
 		this->dampLow = lexical_cast<T>(elem->GetText());
@@ -231,6 +455,9 @@ bool Difference<T>::fromXML(TiXmlHandle &root)
 			return false;
 		}
 
+	Structure<T>::orderByCost(positiveStructures, positiveOrder);
+	Structure<T>::orderByCost(negativeStructures, negativeOrder);
+
 	return true;
 }
 
@@ -25,6 +25,7 @@
 #include <cvmlcpp/volume/DTree>
 
 #include <shapes/Shape.h>
+#include <shapes/CompiledShape.h>
 
 namespace shapes
 {
@@ -33,6 +34,10 @@ template <typename T>
 bool convertToField(const Shape<T> &shape, const T sampleSize,
 		    cvmlcpp::Matrix<T, 3> &field);
 
+template <typename T>
+bool convertToField(const CompiledShape<T> &shape, const T sampleSize,
+		    cvmlcpp::Matrix<T, 3> &field);
+
 } // end namespace
 
 #include <shapes/ExportField.hh>
@@ -19,13 +19,17 @@
  ***************************************************************************/
 
 #include <cmath>
+#include <vector>
 
 namespace shapes
 {
 
-template <typename T>
-bool convertToField(const Shape<T> &shape, const T sampleSize,
-		   cvmlcpp::Matrix<T, 3> &field)
+namespace detail
+{
+
+template <typename S, typename T>
+bool convertToField_(const S &shape, const T sampleSize,
+		     cvmlcpp::Matrix<T, 3> &field)
 {
 	if (shape.empty())
 	{
@@ -43,20 +47,29 @@ bool convertToField(const Shape<T> &shape, const T sampleSize,
 	field.resize(dims);
 	//~ field = 0.0;
 
-	// Compute contributions of structures to the distance field
+	// Compute contributions of structures to the distance field,
+	// one row along the z-axis at a time.
+	const typename EuclidTypes<T>::FPVector step(0, 0, sampleSize);
 #ifdef _OPENMP
-	#pragma omp parallel for
+	#pragma omp parallel
 #endif
-	for (int x = 0; x < int(dimX); ++x)
-	for (std::size_t y = 0; y < dimY; ++y)
-	for (std::size_t z = 0; z < dimZ; ++z)
 	{
-		const typename Shape<T>::FPPoint
-			 p( T(x)*sampleSize + deltaX,
-			    T(y)*sampleSize + deltaY,
-			    T(z)*sampleSize + deltaZ );
+		std::vector<T> row(dimZ);
+#ifdef _OPENMP
+		#pragma omp for
+#endif
+		for (int x = 0; x < int(dimX); ++x)
+		for (std::size_t y = 0; y < dimY; ++y)
+		{
+			const typename EuclidTypes<T>::FPPoint
+				 first( T(x)*sampleSize + deltaX,
+					T(y)*sampleSize + deltaY,
+					deltaZ );
 
-		field[x][y][z] = shape.value(p);
+			shape.values(first, step, &row[0], dimZ);
+			for (std::size_t z = 0; z < dimZ; ++z)
+				field[x][y][z] = row[z];
+		}
 	}
 
 	// Verification
@@ -104,5 +117,21 @@ bool convertToField(const Shape<T> &shape, const T sampleSize,
 	return true;
 }
 
+} // end namespace detail
+
+template <typename T>
+bool convertToField(const Shape<T> &shape, const T sampleSize,
+		   cvmlcpp::Matrix<T, 3> &field)
+{
+	return detail::convertToField_(shape, sampleSize, field);
+}
+
+template <typename T>
+bool convertToField(const CompiledShape<T> &shape, const T sampleSize,
+		   cvmlcpp::Matrix<T, 3> &field)
+{
+	return detail::convertToField_(shape, sampleSize, field);
+}
+
 } // end namespace
 
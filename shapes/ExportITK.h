@@ -14,85 +14,272 @@
 #ifndef SHAPES_EXPORT_ITK_H
 #define SHAPES_EXPORT_ITK_H 1
 
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <string>
-#include <cvmlcpp/base/Matrix>
+#include <vector>
 
-#include <shapes/ExportField.h>
+#include <zlib.h>
+
+#include <shapes/ExportSlabs.h>
 
 namespace shapes
 {
 
+namespace detail
+{
+
+/*
+ * Writes slabs to a MetaImage: an ASCII header, in fileName + ".mhd", and
+ * a binary data file, or both in one file if the name ends in ".mha". The
+ * data may be compressed with zlib; pieces of each slab are then deflated
+ * in parallel and joined into one zlib stream.
+ */
+template <typename T>
+class ITKSink : public SlabSink<T>
+{
+	public:
+		ITKSink(const std::string fileName, const bool compress = false) :
+			fileName_(fileName), compress_(compress),
+			local_(fileName.size() > 4 &&
+			       fileName.substr(fileName.size() - 4) == ".mha"),
+			sizePos_(0), adler_(0), size_(0) { }
+
+		virtual bool start(const FieldSlab<T> &field)
+		{
+			field_ = field;
+
+			output_.open(fileName_.c_str(), std::ios::out    |
+							std::ios::binary |
+							std::ios::trunc);
+			// The header of compressed data is written last, when
+			// its size is known; in the same file it is overwritten.
+			if (!compress_ || local_)
+				this->writeHeader(local_ ? output_ : output_h_);
+			if (compress_)
+			{
+				// zlib header: deflate, fastest
+				const char zlibHeader [] = { 0x78, 0x01 };
+				output_.write(zlibHeader, 2);
+				adler_ = adler32(0L, Z_NULL, 0);
+				size_ = 2;
+			}
+
+			return output_.good();
+		}
+
+		virtual std::size_t pieces(const FieldSlab<T> &slab)
+		{
+			const std::size_t n = (slab.end - slab.begin) * slab.dimX * slab.dimY;
+			const std::size_t m = (n + pieceSize - 1) / pieceSize;
+
+			Slot &slot = slots_[slab.index % 2];
+			slot.floats.resize(n);
+			slot.failed.assign(m, 0);
+			if (compress_)
+			{
+				slot.chunks.resize(m);
+				slot.adlers.resize(m);
+			}
+
+			return m;
+		}
+
+		virtual void prepare(const FieldSlab<T> &slab, const std::size_t piece)
+		{
+			Slot &slot = slots_[slab.index % 2];
+			const std::size_t first = piece * pieceSize;
+			const std::size_t n = std::min(pieceSize, slot.floats.size() - first);
+
+			// note: data layout expects x changing fastest, as in
+			// the layers of a slab.
+			const T * const values = slab.layer(slab.begin) + first;
+			std::copy(values, values + n, slot.floats.begin() + first);
+
+			if (compress_)
+			{
+				const Bytef * const bytes = (const Bytef *)&slot.floats[first];
+				if (!deflate_(bytes, n * sizeof(float), slot.chunks[piece]))
+					slot.failed[piece] = 1;
+				slot.adlers[piece] = adler32(adler32(0L, Z_NULL, 0),
+							     bytes, n * sizeof(float));
+			}
+		}
+
+		virtual bool consume(const FieldSlab<T> &slab)
+		{
+			const Slot &slot = slots_[slab.index % 2];
+			if (std::count(slot.failed.begin(), slot.failed.end(), 1))
+				return false;
+
+			if (!compress_)
+			{
+				output_.write((const char *)&slot.floats[0],
+					      slot.floats.size() * sizeof(float));
+				return output_.good();
+			}
+
+			for (std::size_t i = 0; i < slot.chunks.size(); ++i)
+			{
+				const std::size_t n = std::min(pieceSize,
+						slot.floats.size() - i * pieceSize);
+				output_.write((const char *)&slot.chunks[i][0],
+					      slot.chunks[i].size());
+				size_ += slot.chunks[i].size();
+				adler_ = adler32_combine(adler_, slot.adlers[i],
+							 n * sizeof(float));
+			}
+
+			return output_.good();
+		}
+
+		virtual bool finish()
+		{
+			if (compress_)
+			{
+				// An empty last block, and the checksum
+				const unsigned char trailer [] = { 0x03, 0x00,
+					(unsigned char)(adler_ >> 24), (unsigned char)(adler_ >> 16),
+					(unsigned char)(adler_ >>  8), (unsigned char)(adler_) };
+				output_.write((const char *)trailer, sizeof(trailer));
+				size_ += sizeof(trailer);
+
+				if (local_)
+				{
+					output_.seekp(sizePos_);
+					output_ << std::setw(sizeWidth) << size_;
+				}
+				else
+					this->writeHeader(output_h_);
+			}
+
+			output_.close();
+			return !output_.fail() && (local_ || !output_h_.fail());
+		}
+
+	private:
+		const std::string fileName_;
+		const bool compress_, local_;
+		FieldSlab<T> field_;
+
+		std::ofstream output_, output_h_;
+
+		// Where the compressed size is written in a single file
+		std::streampos sizePos_;
+		static const int sizeWidth = 20;
+
+		// Checksum and size of the compressed data so far
+		uLong adler_;
+		std::size_t size_;
+
+		// Floats per piece
+		static const std::size_t pieceSize = 1u << 18;
+
+		// A slab converted to floats, and compressed if needed, in
+		// pieces; one for the slab being prepared, one for the slab
+		// being written.
+		struct Slot
+		{
+			std::vector<float> floats;
+			std::vector<std::vector<unsigned char> > chunks;
+			std::vector<uLong> adlers;
+			std::vector<char> failed;
+		};
+		Slot slots_[2];
+
+		void writeHeader(std::ofstream &out_h)
+		{
+			// we must know the voxel size! Seems to be always 1 ...
+			const float vx = field_.sampleSize;
+			const float vy = field_.sampleSize;
+			const float vz = field_.sampleSize;
+
+			// where do we get the offset? Must keep track of deltax + padding
+			const float ox = field_.deltaX+0.5f*vx;
+			const float oy = field_.deltaY+0.5f*vy;
+			const float oz = field_.deltaZ+0.5f*vz;
+
+			if (!local_)
+			{
+				std::string header_name = fileName_ + ".mhd";
+				out_h.open(header_name.c_str());
+			}
+
+			out_h << "ObjectType = Image\n"
+				<< "NDims = 3\n"
+				<< "BinaryData = True\n"
+				<< "BinaryDataByteOrderMSB = False\n";
+			if (compress_)
+			{
+				out_h << "CompressedData = True\n"
+					<< "CompressedDataSize = ";
+				sizePos_ = out_h.tellp();
+				out_h << std::setw(sizeWidth) << size_ << "\n";
+			}
+			out_h	<< "ElementSize = " << vx << " " << vy << " " << vz <<  "\n"
+				<< "Offset      = " << ox << " " << oy << " " << oz <<  "\n"
+				<< "TransformMatrix = 1 0 0  0 1 0  0 0 1 \n"
+				<< "DimSize = "
+				<< field_.dimX << " "
+				<< field_.dimY << " "
+				<< field_.dimZ << "\n"
+				<< "ElementType = MET_FLOAT\n"
+				<< "ElementDataFile = " << (local_ ? std::string("LOCAL") : fileName_) << "\n"
+				<< std::flush;
+
+			if (!local_)
+				out_h.close();
+		}
+
+		// Raw deflate, ending on a byte boundary so that pieces can
+		// be joined.
+		static bool deflate_(const Bytef * const bytes, const std::size_t n,
+				     std::vector<unsigned char> &out)
+		{
+			z_stream zs;
+			zs.zalloc = Z_NULL;
+			zs.zfree  = Z_NULL;
+			zs.opaque = Z_NULL;
+			if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, -15, 8,
+					 Z_DEFAULT_STRATEGY) != Z_OK)
+				return false;
+
+			out.resize(deflateBound(&zs, n) + 16);
+			zs.next_in   = const_cast<Bytef *>(bytes);
+			zs.avail_in  = n;
+			zs.next_out  = &out[0];
+			zs.avail_out = out.size();
+			const bool ok = (deflate(&zs, Z_SYNC_FLUSH) == Z_OK) &&
+					(zs.avail_in == 0) && (zs.avail_out > 0);
+			out.resize(out.size() - zs.avail_out);
+			deflateEnd(&zs);
+
+			return ok;
+		}
+};
+
+template <typename T>
+const int ITKSink<T>::sizeWidth;
+
+template <typename T>
+const std::size_t ITKSink<T>::pieceSize;
+
+} // end namespace detail
+
 namespace io {
 
+/*
+ * The field is computed and written slab by slab, see streamField(). A
+ * name ending in ".mha" gives a single file; 'compress' deflates the
+ * data with zlib.
+ */
 template <typename T>
 bool exportITK(const std::string fileName, const Shape<T> &shape,
-		const T sampleSize = 1.)
+		const T sampleSize = 1., const bool compress = false)
 {
-	// Generate the field
-	cvmlcpp::Matrix<T, 3> field;
-	if (!convertToField(shape, sampleSize, field))
-		return false;
-
-	// Get constants, we need the offsets delta*
-	std::size_t dimX, dimY, dimZ;
-	T deltaX, deltaY, deltaZ;
-	calcShapeConsts(shape, sampleSize, dimX, dimY, dimZ,
-			deltaX, deltaY, deltaZ);
-
-	// we must know the voxel size! Seems to be always 1 ...
-	const float vx = sampleSize;
-	const float vy = sampleSize;
-	const float vz = sampleSize;
-
-	// where do we get the offset? Must keep track of deltax + padding
-	const float ox = deltaX+0.5f*vx;
-	const float oy = deltaY+0.5f*vy;
-	const float oz = deltaZ+0.5f*vz;
-
-	// note: Format consist of two files, an ASCII header
-	// and a binary data file.
-
-	// write header
-	std::string header_name = fileName + ".mhd";
-	std::ofstream out_h(header_name.c_str());
-	out_h << "ObjectType = Image\n"
-		<< "NDims = 3\n"
-		<< "BinaryData = True\n"
-		<< "BinaryDataByteOrderMSB = False\n"
-		<< "ElementSize = " << vx << " " << vy << " " << vz <<  "\n"
-		<< "Offset      = " << ox << " " << oy << " " << oz <<  "\n"
-		<< "TransformMatrix = 1 0 0  0 1 0  0 0 1 \n"
-		<< "DimSize = "
-		<< field.extent(X) << " "
-		<< field.extent(Y) << " "
-		<< field.extent(Z) << "\n"
-		<< "ElementType = MET_FLOAT\n"
-		<< "ElementDataFile = " << fileName << "\n"
-		<< std::flush;
-
-	out_h.close();
-
-	// write binary raw data file
-	std::ofstream output(fileName.c_str(),  std::ios::out    |
-						std::ios::binary |
-						std::ios::trunc);
-
-	for(std::size_t z = 0; z < field.extent(Z); ++z)
-	for(std::size_t y = 0; y < field.extent(Y); ++y)
-	for(std::size_t x = 0; x < field.extent(X); ++x)
-	{
-		// note: data layout expects x changing fastest.
-		// the extremely nonlinear values cause visualisation problems
-		// attempt to transform mapping 1 -> 0, inside < 0, outside > 0
-		// float eps = 0.1;
-		// val = 1.0/(eps+val) - 1.0/(1.0 + eps);
-		float val = field[x][y][z];
-		output.write((char *)&val, sizeof(float));
-	}
-	output.close();
-
-	return true;
+	detail::ITKSink<T> sink(fileName, compress);
+	return streamField(shape, sampleSize, sink);
 }
 
 } // end namespace io
@@ -21,10 +21,13 @@
 #ifndef SHAPES_EXPORT_OCTREE_H
 #define SHAPES_EXPORT_OCTREE_H 1
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <vector>
+#include <tr1/cstdint>
 
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
@@ -36,79 +39,184 @@
 #include <cvmlcpp/volume/Voxelizer>
 
 #include <shapes/Shape.h>
+#include <shapes/CompiledShape.h>
+#include <shapes/ExportSlabs.h>
+#include <shapes/SpanVoxels.h>
 
 namespace shapes {
 
 namespace detail
 {
+/*
+ * Finds where the field crosses 1 along the rows of samples parallel to
+ * each of the three axes, in one pass over the slabs of streamField(),
+ * classifying samples by value >= 1. Each layer is a piece; the last
+ * layer of each slab is kept for the crossings along the z-axis into the
+ * next. Crossings are kept in flat arrays of rays and positions per axis,
+ * in the order of the positions along each ray, until zBuffers() hands
+ * them out.
+ */
 template <typename T>
-void shapeToZBuffer(const Shape<T> &shape, const unsigned axis,
-		     const std::size_t dimX, const std::size_t dimY, const std::size_t dimZ,
-		     const T &deltaX, const T &deltaY, const T &deltaZ,
-		     const T sampleSize,
-		     cvmlcpp::Matrix<std::vector<double>, 2u> &zBuffer)
+class CrossingSink : public SlabSink<T>
 {
-	const unsigned _dm[][4] =
-	{
-		{Z, Y, X, 0u},
-		{X, Z, Y, 0u},
-		{X, Y, Z, 0u}
-	};
+	public:
+		typedef std::tr1::uint32_t Ray;
 
-	const unsigned XX = _dm[axis][X];
-	const unsigned YY = _dm[axis][Y];
-	const unsigned ZZ = _dm[axis][Z];
+		virtual bool start(const FieldSlab<T> &field)
+		{
+			field_ = field;
+			for (unsigned axis = 0; axis < 3; ++axis)
+			{
+				rays_[axis].clear();
+				positions_[axis].clear();
+			}
+			return true;
+		}
+
+		virtual std::size_t pieces(const FieldSlab<T> &slab)
+		{
+			std::vector<Layer> &layers = layers_[slab.index % 2];
+			layers.resize(slab.end - slab.begin);
+			return layers.size();
+		}
 
-	const std::size_t dim [] = {dimX, dimY, dimZ};
-	const T delta [] = {deltaX, deltaY, deltaZ};
+		virtual void prepare(const FieldSlab<T> &slab, const std::size_t piece);
 
-#ifdef _OPENMP
-	#pragma omp parallel for
-#endif
-	for (int x = 0; x < int(dim[XX]); ++x)
-	for (std::size_t y = 0; y < dim[YY]; ++y)
-	{
-		T    prevField = 0.;
-		bool prevValue = false;
-		for (std::size_t z = 0; z < dim[ZZ]; ++z)
+		virtual bool consume(const FieldSlab<T> &slab)
 		{
-			assert(prevValue == (prevField >= T(1)));
+			std::vector<Layer> &layers = layers_[slab.index % 2];
+			for (std::size_t i = 0; i < layers.size(); ++i)
+			for (unsigned axis = 0; axis < 3; ++axis)
+			{
+				rays_[axis].insert(rays_[axis].end(),
+					layers[i].rays[axis].begin(), layers[i].rays[axis].end());
+				positions_[axis].insert(positions_[axis].end(),
+					layers[i].positions[axis].begin(), layers[i].positions[axis].end());
+				std::vector<Ray>().swap(layers[i].rays[axis]);
+				std::vector<double>().swap(layers[i].positions[axis]);
+			}
+			return true;
+		}
 
-			typename Shape<T>::FPPoint p;
-			p[XX] = T(x)*sampleSize + delta[XX];
-			p[YY] = T(y)*sampleSize + delta[YY];
-			p[ZZ] = T(z)*sampleSize + delta[ZZ];
+		// Move the crossings into z-buffers as for zBuffersToDTree_(),
+		// each vector allocated once.
+		void zBuffers(cvmlcpp::Matrix<std::vector<double>, 2u> zBuffers[3]);
 
-			const T    currentField = shape.value(p);
-			const bool currentValue = currentField >= T(1);
+	private:
+		FieldSlab<T> field_;
 
-			if (prevValue != currentValue)
-			{
-				// Interpolation to find crossing point
-				const T d = (currentField - T(1)) /
-					// ----------------------------
-					    (currentField - prevField);
-				assert(d >= 0);
+		std::vector<Ray> rays_[3];
+		std::vector<double> positions_[3];
 
-				const T z_in_space = p[ZZ]-sampleSize*d;
-				assert( z_in_space <= p[ZZ]);
-				assert( z_in_space >= p[ZZ]-sampleSize);
+		// Crossings found in one layer
+		struct Layer
+		{
+			std::vector<Ray> rays[3];
+			std::vector<double> positions[3];
+		};
+		std::vector<Layer> layers_[2];
 
-				zBuffer[x][y].push_back(z_in_space - delta[ZZ]);
-				assert(zBuffer[x][y].back() >= 0.);
+		// Last layer of the slab before
+		std::vector<T> last_[2];
 
-				prevValue = currentValue;
+		// Rays along the axes: [z][y], [x][z] and [x][y]
+		Ray ray(const unsigned axis, const std::size_t x,
+			const std::size_t y, const std::size_t z) const
+		{
+			switch (axis)
+			{
+				case X: return z * field_.dimY + y;
+				case Y: return x * field_.dimZ + z;
+				default: return x * field_.dimY + y;
 			}
-			prevField = currentField;
 		}
+
+		// If samples i-1 and i along an axis are on either side of 1,
+		// add the crossing, relative to the first sample of the ray.
+		static void cross(Layer &layer, const unsigned axis, const Ray ray,
+				  const std::size_t i, const T prevField,
+				  const T currentField, const T sampleSize, const T delta)
+		{
+			if ((prevField >= T(1)) == (currentField >= T(1)))
+				return;
+
+			// Interpolation to find the crossing point, kept
+			// between the two samples against rounding.
+			const T p = T(i)*sampleSize + delta;
+			T d = (currentField - T(1)) /
+			// ----------------------------
+			      (currentField - prevField);
+			if (!(d >= T(0)))
+				d = T(0);
+			d = std::min(d, T(1));
+
+			layer.rays[axis].push_back(ray);
+			layer.positions[axis].push_back((p - sampleSize*d) - delta);
+		}
+};
+
+template <typename T>
+void CrossingSink<T>::prepare(const FieldSlab<T> &slab, const std::size_t piece)
+{
+	const std::size_t dimX = slab.dimX;
+	const std::size_t dimY = slab.dimY;
+	const std::size_t z = slab.begin + piece;
+	const T sampleSize = slab.sampleSize;
+	Layer &layer = layers_[slab.index % 2][piece];
+
+	const T * const current = slab.layer(z);
+	const T * const previous = (z == 0) ? 0 :
+		(z > slab.lower) ? slab.layer(z - 1) : &last_[(slab.index + 1) % 2][0];
+	if (z + 1 == slab.end)
+		last_[slab.index % 2].assign(current, current + dimX * dimY);
+
+	for (std::size_t y = 0; y < dimY; ++y)
+	for (std::size_t x = 0; x < dimX; ++x)
+	{
+		const std::size_t i = y * dimX + x;
+		cross(layer, X, this->ray(X, x, y, z), x,
+		      (x > 0) ? current[i - 1] : T(0), current[i],
+		      sampleSize, slab.deltaX);
+		cross(layer, Y, this->ray(Y, x, y, z), y,
+		      (y > 0) ? current[i - dimX] : T(0), current[i],
+		      sampleSize, slab.deltaY);
+		cross(layer, Z, this->ray(Z, x, y, z), z,
+		      previous ? previous[i] : T(0), current[i],
+		      sampleSize, slab.deltaZ);
 	}
 }
 
-} // end namespace detail
+template <typename T>
+void CrossingSink<T>::zBuffers(cvmlcpp::Matrix<std::vector<double>, 2u> zBuffers[3])
+{
+	const std::size_t rays [] = { field_.dimZ * field_.dimY,
+				      field_.dimX * field_.dimZ,
+				      field_.dimX * field_.dimY };
+	const std::size_t columns [] = { field_.dimY, field_.dimZ, field_.dimY };
 
-template <typename T, typename V>
-bool convertToOctree(const Shape<T> &shape, const T sampleSize,
-			cvmlcpp::DTree<V, 3> &voxtree)
+	for (unsigned axis = 0; axis < 3; ++axis)
+	{
+		std::vector<std::size_t> counts(rays[axis], 0);
+		for (std::size_t i = 0; i < rays_[axis].size(); ++i)
+			++counts[rays_[axis][i]];
+
+		for (std::size_t r = 0; r < rays[axis]; ++r)
+			zBuffers[axis][r / columns[axis]][r % columns[axis]].reserve(counts[r]);
+		for (std::size_t i = 0; i < rays_[axis].size(); ++i)
+		{
+			const Ray r = rays_[axis][i];
+			zBuffers[axis][r / columns[axis]][r % columns[axis]].push_back(
+				positions_[axis][i]);
+		}
+
+		std::vector<Ray>().swap(rays_[axis]);
+		std::vector<double>().swap(positions_[axis]);
+	}
+}
+
+template <typename S, typename T, typename V>
+bool convertToOctree_(const S &shape, const T sampleSize,
+		      cvmlcpp::DTree<V, 3> &voxtree)
 {
 	if (shape.empty())
 	{
@@ -116,6 +224,10 @@ bool convertToOctree(const Shape<T> &shape, const T sampleSize,
 		return true;
 	}
 
+	CrossingSink<T> crossings;
+	if (!streamField(shape, sampleSize, crossings))
+		return false;
+
 	std::size_t dimX, dimY, dimZ;
 	T deltaX, deltaY, deltaZ;
 	calcShapeConsts(shape, sampleSize, dimX, dimY, dimZ,
@@ -127,20 +239,138 @@ bool convertToOctree(const Shape<T> &shape, const T sampleSize,
 	const std::size_t matrixDims [] = { dimension, dimension };
 	cvmlcpp::Matrix<std::vector<double>, 2u> zBuffers[3];
 	for (unsigned axis = 0; axis < 3; ++axis)
-	{
 		zBuffers[axis].resize(matrixDims);
+	crossings.zBuffers(zBuffers);
+
+	// Abuse cvmlcpp internals ... Not chique
+	const cvmlcpp::fVector3D subVoxOffset = 0.5;
+	cvmlcpp::detail::zBuffersToDTree_(voxtree, sampleSize, subVoxOffset, zBuffers, V(1), V(0));
+
+	return true;
+}
+
+// Halfway between voxels t-1 and t; at 0 for t = 0, since
+// zBuffersToDTree_() takes no positions before the first voxel.
+template <typename T>
+double spanCrossing(const std::size_t t, const T sampleSize)
+{
+	return std::max(0., (double(t) - 0.5) * sampleSize);
+}
+
+/*
+ * Z-buffers for zBuffersToDTree_(): per ray, the positions relative to the
+ * first voxel where the voxels change, halfway between the two voxels.
+ * Along the x- and y-axes, these are the transitions of the difference of
+ * neighbouring columns. Unlike sampled fields, span voxels may be inside
+ * at the boundary of the volume; see spanCrossing().
+ */
+template <typename T>
+void spansToZBuffers(const SpanVoxels &spans, const T sampleSize,
+		     cvmlcpp::Matrix<std::vector<double>, 2u> zBuffers[3])
+{
+	const std::size_t dimX = spans.extent(X);
+	const std::size_t dimY = spans.extent(Y);
+	const SpanVoxels::Index * const none = 0;
+
+	// Along the z-axis: zBuffers[Z][x][y]
+#ifdef _OPENMP
+	#pragma omp parallel for
+#endif
+	for (int x = 0; x < int(dimX); ++x)
+	for (std::size_t y = 0; y < dimY; ++y)
+		for (const SpanVoxels::Index *t = spans.begin(x, y);
+		     t != spans.end(x, y); ++t)
+			zBuffers[Z][x][y].push_back(spanCrossing(*t, sampleSize));
 
-		for (std::size_t x = 0u; x < dimension; ++x)
-		for (std::size_t y = 0u; y < dimension; ++y)
-			assert(zBuffers[axis][x][y].empty());
+	// Along the x-axis: zBuffers[X][z][y]
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+		std::vector<SpanVoxels::Index> changes;
+#ifdef _OPENMP
+		#pragma omp for
+#endif
+		for (int y = 0; y < int(dimY); ++y)
+		for (std::size_t x = 0; x <= dimX; ++x)
+		{
+			changes.clear();
+			std::set_symmetric_difference(
+				(x > 0)    ? spans.begin(x-1, y) : none,
+				(x > 0)    ? spans.end  (x-1, y) : none,
+				(x < dimX) ? spans.begin(x,   y) : none,
+				(x < dimX) ? spans.end  (x,   y) : none,
+				std::back_inserter(changes) );
+			for (std::size_t i = 0; i < changes.size(); i += 2)
+				for (std::size_t z = changes[i]; z < changes[i+1]; ++z)
+					zBuffers[X][z][y].push_back(spanCrossing(x, sampleSize));
+		}
+	}
 
-		// Build Z-Buffer using projection along given axis
-		detail::shapeToZBuffer( shape, axis, dimX, dimY, dimZ,
-					deltaX, deltaY, deltaZ,
-					sampleSize, zBuffers[axis]);
+	// Along the y-axis: zBuffers[Y][x][z]
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+		std::vector<SpanVoxels::Index> changes;
+#ifdef _OPENMP
+		#pragma omp for
+#endif
+		for (int x = 0; x < int(dimX); ++x)
+		for (std::size_t y = 0; y <= dimY; ++y)
+		{
+			changes.clear();
+			std::set_symmetric_difference(
+				(y > 0)    ? spans.begin(x, y-1) : none,
+				(y > 0)    ? spans.end  (x, y-1) : none,
+				(y < dimY) ? spans.begin(x, y  ) : none,
+				(y < dimY) ? spans.end  (x, y  ) : none,
+				std::back_inserter(changes) );
+			for (std::size_t i = 0; i < changes.size(); i += 2)
+				for (std::size_t z = changes[i]; z < changes[i+1]; ++z)
+					zBuffers[Y][x][z].push_back(spanCrossing(y, sampleSize));
+		}
 	}
+}
+
+} // end namespace detail
+
+template <typename T, typename V>
+bool convertToOctree(const Shape<T> &shape, const T sampleSize,
+			cvmlcpp::DTree<V, 3> &voxtree)
+{
+	return detail::convertToOctree_(shape, sampleSize, voxtree);
+}
+
+template <typename T, typename V>
+bool convertToOctree(const CompiledShape<T> &shape, const T sampleSize,
+			cvmlcpp::DTree<V, 3> &voxtree)
+{
+	return detail::convertToOctree_(shape, sampleSize, voxtree);
+}
+
+// From voxels sampled with the given size
+template <typename T, typename V>
+bool convertToOctree(const SpanVoxels &spans, const T sampleSize,
+			cvmlcpp::DTree<V, 3> &voxtree)
+{
+	if (spans.empty())
+	{
+		voxtree.collapse(0);
+		return true;
+	}
+
+	const std::size_t maxDim    = std::max(spans.extent(X),
+					std::max(spans.extent(Y), spans.extent(Z)));
+	const std::size_t dimension = cvmlcpp::isPower2(maxDim) ?
+				maxDim : (2u << cvmlcpp::log2(maxDim));
+	const std::size_t matrixDims [] = { dimension, dimension };
+	cvmlcpp::Matrix<std::vector<double>, 2u> zBuffers[3];
+	for (unsigned axis = 0; axis < 3; ++axis)
+		zBuffers[axis].resize(matrixDims);
+
+	detail::spansToZBuffers(spans, sampleSize, zBuffers);
 
-	// Abuse cvmlcpp internals ... Not chique
 	const cvmlcpp::fVector3D subVoxOffset = 0.5;
 	cvmlcpp::detail::zBuffersToDTree_(voxtree, sampleSize, subVoxOffset, zBuffers, V(1), V(0));
 
@@ -28,53 +28,62 @@
 #include <cvmlcpp/volume/VolumeIO>
 
 #include <shapes/Shape.h>
+#include <shapes/CompiledShape.h>
 
 namespace shapes {
 
 namespace detail {
 
-template <typename T>
+template <typename T, typename S = Shape<T> >
 class ShapeSurfaceAdaptor
 {
 	public:
 		typedef T value_type;
 
-		ShapeSurfaceAdaptor(const Shape<T> &shape, const T sampleSize,
+		ShapeSurfaceAdaptor(const S &shape, const T sampleSize,
 				const std::size_t dimX, const std::size_t dimY, const std::size_t dimZ,
 				const T deltaX, const T deltaY, const T deltaZ) : shape_(shape),
 				sampleSize_(sampleSize), dimX_(dimX), dimY_(dimY), dimZ_(dimZ),
 				deltaX_(deltaX), deltaY_(deltaY), deltaZ_(deltaZ)
 		{
-			const std::size_t noKey = dimX_*dimY_*dimZ_;
-			cache_.resize(dimZ);
-			for (std::size_t z = 0; z < dimZ; ++z)
+			const std::size_t noKey = dimX_*dimY_;
 			for (int i = 0; i < 4; ++i)
-				cache_[z][i].first = noKey;
+			{
+				cache_[i].key = noKey;
+				cache_[i].begin = cache_[i].end = 0;
+			}
 		}
 
 		T operator()(const std::size_t x, const std::size_t y, const std::size_t z) const
 		{
-			// Search in cache to see if we've recently computed this
-			const std::size_t key = x*dimY_*dimZ_ + y*dimZ_ + z;
+			// Search in cache to see if we've recently computed this.
+			// Values are cached per column (x, y), in blocks along the
+			// z-axis that are computed in one go.
+			const std::size_t key = x*dimY_ + y;
 
 			const int index = ((x&0x1)<<1) | (y&0x1);
-
-			if (cache_[z][index].first == key)
-				return cache_[z][index].second;
-
-			const typename Shape<T>::FPPoint
-				 p( T(x)*sampleSize_ + deltaX_,
-				    T(y)*sampleSize_ + deltaY_,
-				    T(z)*sampleSize_ + deltaZ_ );
-			const T value = shape_.value(p);
-
-			// This is not needed as each thread should have it's own Adapter.
-			// #ifdef _OPENMP
-			// #pragma omp critical(SHAPES_EVAL)
-			// #endif
-			cache_[z][index].first  = key;
-			cache_[z][index].second = value;
-			return value;
+			Block &block = cache_[index];
+
+			if (block.key != key || z < block.begin || z >= block.end)
+			{
+				block.key   = key;
+				block.begin = z;
+				block.end   = std::min(z + Structure<T>::blockSize, dimZ_);
+
+				const typename EuclidTypes<T>::FPPoint
+					 first( T(x)*sampleSize_ + deltaX_,
+						T(y)*sampleSize_ + deltaY_,
+						T(z)*sampleSize_ + deltaZ_ );
+				const typename EuclidTypes<T>::FPVector step(0, 0, sampleSize_);
+
+				// This is not needed as each thread should have it's own Adapter.
+				// #ifdef _OPENMP
+				// #pragma omp critical(SHAPES_EVAL)
+				// #endif
+				shape_.values(first, step, block.values, block.end - block.begin);
+			}
+
+			return block.values[z - block.begin];
 		}
 
 		template <typename It>
@@ -86,26 +95,30 @@ class ShapeSurfaceAdaptor
 		}
 
 	private:
-		const Shape<T> &shape_;
+		const S &shape_;
 		const T sampleSize_;
 		const std::size_t dimX_, dimY_, dimZ_;
 		const T deltaX_, deltaY_, deltaZ_;
-		mutable std::vector<std::tr1::array<std::pair<std::size_t, T>, 4> > cache_;
-};
 
-} // end namespace detail
+		struct Block
+		{
+			std::size_t key, begin, end;
+			T values[Structure<T>::blockSize];
+		};
+		mutable Block cache_[4];
+};
 
-template <typename T>
-bool convertToGeometry( const Shape<T> &shape, const T sampleSize,
+template <typename S, typename T>
+bool convertToGeometry_(const S &shape, const T sampleSize,
 			cvmlcpp::Geometry<T> &geometry)
 {
 	std::size_t dimX, dimY, dimZ;
 	T deltaX, deltaY, deltaZ;
 	calcShapeConsts(shape, sampleSize, dimX, dimY, dimZ, deltaX, deltaY, deltaZ);
-	const detail::ShapeSurfaceAdaptor<T> sAdaptor =
-			detail::ShapeSurfaceAdaptor<T>( shape, sampleSize,
-							dimX, dimY, dimZ,
-							deltaX, deltaY, deltaZ);
+	const ShapeSurfaceAdaptor<T, S> sAdaptor =
+			ShapeSurfaceAdaptor<T, S>( shape, sampleSize,
+						   dimX, dimY, dimZ,
+						   deltaX, deltaY, deltaZ);
 	cvmlcpp::extractSurfaceFromAdapter(sAdaptor, geometry, T(1));
 
 //	geometry.scale(sampleSize);
@@ -114,6 +127,22 @@ bool convertToGeometry( const Shape<T> &shape, const T sampleSize,
 	return true;
 }
 
+} // end namespace detail
+
+template <typename T>
+bool convertToGeometry( const Shape<T> &shape, const T sampleSize,
+			cvmlcpp::Geometry<T> &geometry)
+{
+	return detail::convertToGeometry_(shape, sampleSize, geometry);
+}
+
+template <typename T>
+bool convertToGeometry( const CompiledShape<T> &shape, const T sampleSize,
+			cvmlcpp::Geometry<T> &geometry)
+{
+	return detail::convertToGeometry_(shape, sampleSize, geometry);
+}
+
 namespace io
 {
 
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_EXPORT_SLABS_H
+#define SHAPES_EXPORT_SLABS_H 1
+
+#include <vector>
+
+#include <shapes/Shape.h>
+#include <shapes/CompiledShape.h>
+
+namespace shapes
+{
+
+/*
+ * A range of layers along the z-axis of the field of convertToField(),
+ * with the position of the whole field. Values are stored for layers
+ * [lower, upper): the layers [begin, end) of the slab plus a halo on
+ * either side, clipped to the field.
+ */
+template <typename T>
+class FieldSlab
+{
+	public:
+		FieldSlab() : dimX(0), dimY(0), dimZ(0), sampleSize(1),
+			deltaX(0), deltaY(0), deltaZ(0),
+			index(0), begin(0), end(0), lower(0), upper(0) { }
+
+		std::size_t dimX, dimY, dimZ;
+		T sampleSize, deltaX, deltaY, deltaZ;
+
+		// Number of the slab, from 0
+		std::size_t index;
+		std::size_t begin, end, lower, upper;
+
+		// Layer z, with x changing fastest
+		const T *layer(const std::size_t z) const
+		{
+			assert(z >= lower && z < upper);
+			return &values[(z - lower) * dimX * dimY];
+		}
+
+		T operator()(const std::size_t x, const std::size_t y,
+			     const std::size_t z) const
+		{ return this->layer(z)[y * dimX + x]; }
+
+		std::vector<T> values;
+};
+
+/*
+ * Receives the slabs of a field one by one, by increasing z, from a single
+ * thread while the next slabs are being computed. Work on a slab that can
+ * be split, such as converting or compressing it, may be done beforehand
+ * by all threads: prepare() is called for each of the pieces() of a slab,
+ * before consume() of that slab but possibly during consume() of the
+ * previous one.
+ */
+template <typename T>
+class SlabSink
+{
+	public:
+		virtual ~SlabSink() { }
+
+		// Layers needed beyond either side of each slab
+		virtual std::size_t halo() const { return 0; }
+
+		// Called before the first slab, with a slab that holds no
+		// layers but describes the field.
+		virtual bool start(const FieldSlab<T> &field) { return true; }
+
+		// Called from one thread, before any prepare() of the slab
+		virtual std::size_t pieces(const FieldSlab<T> &slab) { return 0; }
+
+		// Called from several threads at once, for different pieces
+		virtual void prepare(const FieldSlab<T> &slab, const std::size_t piece) { }
+
+		virtual bool consume(const FieldSlab<T> &slab) = 0;
+
+		// Called after the last slab
+		virtual bool finish() { return true; }
+};
+
+/*
+ * Compute the field of convertToField() slab by slab and hand the slabs to
+ * the sinks, so that only three slabs are in memory at any time. Slabs are
+ * 'layers' thick, or as thick as fits about 32 MB if 0.
+ */
+template <typename T>
+bool streamField(const Shape<T> &shape, const T sampleSize,
+		 const std::vector<SlabSink<T> *> &sinks,
+		 const std::size_t layers = 0);
+
+template <typename T>
+bool streamField(const CompiledShape<T> &shape, const T sampleSize,
+		 const std::vector<SlabSink<T> *> &sinks,
+		 const std::size_t layers = 0);
+
+template <typename T>
+bool streamField(const Shape<T> &shape, const T sampleSize,
+		 SlabSink<T> &sink, const std::size_t layers = 0);
+
+template <typename T>
+bool streamField(const CompiledShape<T> &shape, const T sampleSize,
+		 SlabSink<T> &sink, const std::size_t layers = 0);
+
+} // end namespace
+
+#include <shapes/ExportSlabs.hh>
+
+#endif
@@ -0,0 +1,184 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <vector>
+
+namespace shapes
+{
+
+namespace detail
+{
+
+// Hand the slab to all sinks; stops at the first that fails
+template <typename T>
+bool consumeSlab_(const std::vector<SlabSink<T> *> &sinks, const FieldSlab<T> &slab)
+{
+	for (std::size_t i = 0; i < sinks.size(); ++i)
+		if (!sinks[i]->consume(slab))
+			return false;
+	return true;
+}
+
+template <typename S, typename T>
+bool streamField_(const S &shape, const T sampleSize,
+		  const std::vector<SlabSink<T> *> &sinks,
+		  std::size_t layers)
+{
+	FieldSlab<T> field;
+	if (!shape.empty())
+		calcShapeConsts(shape, sampleSize, field.dimX, field.dimY, field.dimZ,
+				field.deltaX, field.deltaY, field.deltaZ);
+	field.sampleSize = sampleSize;
+
+	std::size_t halo = 0;
+	for (std::size_t i = 0; i < sinks.size(); ++i)
+	{
+		halo = std::max(halo, sinks[i]->halo());
+		if (!sinks[i]->start(field))
+			return false;
+	}
+
+	const std::size_t layerSize = field.dimX * field.dimY;
+	if (layers == 0)
+		layers = std::max(std::size_t(1), (std::size_t(32) << 20) /
+				  (sizeof(T) * std::max(layerSize, std::size_t(1))));
+	const std::size_t slabs = (field.dimZ + layers - 1) / layers;
+
+	// While the sinks take one slab, they prepare the next, and the one
+	// after that is computed.
+	FieldSlab<T> buffers[3] = { field, field, field };
+	for (unsigned b = 0; b < 3; ++b)
+		buffers[b].values.resize(std::min(layers + 2*halo, field.dimZ) * layerSize);
+
+	// Pieces to prepare, of all sinks together
+	std::vector<std::size_t> pieces(sinks.size() + 1, 0);
+
+	const typename EuclidTypes<T>::FPVector step(sampleSize, 0, 0);
+	bool ok = true;
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	for (std::size_t s = 0; s <= slabs + 1; ++s)
+	{
+		FieldSlab<T> &slab = buffers[s % 3];
+		const FieldSlab<T> &prepared = buffers[(s + 2) % 3];
+#ifdef _OPENMP
+		#pragma omp single
+#endif
+		{
+			if (s < slabs)
+			{
+				slab.index = s;
+				slab.begin = s * layers;
+				slab.end   = std::min(slab.begin + layers, field.dimZ);
+				slab.lower = (slab.begin > halo) ? slab.begin - halo : 0;
+				slab.upper = std::min(slab.end + halo, field.dimZ);
+			}
+
+			for (std::size_t i = 0; i < sinks.size(); ++i)
+				pieces[i+1] = pieces[i] + ( (s > 0 && s <= slabs) ?
+					sinks[i]->pieces(prepared) : 0 );
+		}
+
+#ifdef _OPENMP
+		#pragma omp master
+#endif
+		if (s > 1)
+			ok = consumeSlab_(sinks, buffers[(s + 1) % 3]);
+
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic) nowait
+#endif
+		for (int p = 0; p < int(pieces.back()); ++p)
+		{
+			const std::size_t i = std::upper_bound(pieces.begin(), pieces.end(),
+						std::size_t(p)) - pieces.begin() - 1;
+			sinks[i]->prepare(prepared, p - pieces[i]);
+		}
+
+		// Rows along the x-axis, so layers come out in the order
+		// of the image formats.
+		const int rows = (s < slabs) ? int((slab.upper - slab.lower) * field.dimY) : 0;
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic) nowait
+#endif
+		for (int r = 0; r < rows; ++r)
+		{
+			const std::size_t z = slab.lower + r / field.dimY;
+			const std::size_t y = r % field.dimY;
+			const typename EuclidTypes<T>::FPPoint
+				 first( field.deltaX,
+					T(y)*sampleSize + field.deltaY,
+					T(z)*sampleSize + field.deltaZ );
+			shape.values(first, step, &slab.values[r * field.dimX], field.dimX);
+		}
+
+#ifdef _OPENMP
+		#pragma omp barrier
+#endif
+		if (!ok)
+			break;
+	}
+	if (!ok)
+		return false;
+
+	for (std::size_t i = 0; i < sinks.size(); ++i)
+		if (!sinks[i]->finish())
+			return false;
+
+	return true;
+}
+
+} // end namespace detail
+
+template <typename T>
+bool streamField(const Shape<T> &shape, const T sampleSize,
+		 const std::vector<SlabSink<T> *> &sinks,
+		 const std::size_t layers)
+{
+	return detail::streamField_(shape, sampleSize, sinks, layers);
+}
+
+template <typename T>
+bool streamField(const CompiledShape<T> &shape, const T sampleSize,
+		 const std::vector<SlabSink<T> *> &sinks,
+		 const std::size_t layers)
+{
+	return detail::streamField_(shape, sampleSize, sinks, layers);
+}
+
+template <typename T>
+bool streamField(const Shape<T> &shape, const T sampleSize,
+		 SlabSink<T> &sink, const std::size_t layers)
+{
+	return detail::streamField_(shape, sampleSize,
+			std::vector<SlabSink<T> *>(1, &sink), layers);
+}
+
+template <typename T>
+bool streamField(const CompiledShape<T> &shape, const T sampleSize,
+		 SlabSink<T> &sink, const std::size_t layers)
+{
+	return detail::streamField_(shape, sampleSize,
+			std::vector<SlabSink<T> *>(1, &sink), layers);
+}
+
+} // end namespace
@@ -21,9 +21,14 @@
 #ifndef SHAPES_EXPORT_VOX_H
 #define SHAPES_EXPORT_VOX_H 1
 
+#include <algorithm>
+
 #include <omptl/omptl_algorithm>
 
 #include <shapes/Shape.h>
+#include <shapes/CompiledShape.h>
+#include <shapes/BitVoxels.h>
+#include <shapes/SpanVoxels.h>
 
 namespace shapes {
 
@@ -47,13 +52,294 @@ bool convertToVoxels(const cvmlcpp::Matrix<T, 3> &field,
 	return true;
 }
 
+namespace detail
+{
+
+// Classify the samples of convertToField() directly, without the field
+template <typename S, typename T, typename V>
+bool convertToVoxels_(const S &shape, const T sampleSize,
+		      cvmlcpp::Matrix<V, 3> &voxels)
+{
+	if (shape.empty())
+	{
+		voxels.clear();
+		return true;
+	}
+
+	std::size_t dimX, dimY, dimZ;
+	T deltaX, deltaY, deltaZ;
+	calcShapeConsts(shape, sampleSize, dimX, dimY, dimZ,
+			deltaX, deltaY, deltaZ);
+
+	const std::size_t dims [] = {dimX, dimY, dimZ};
+	voxels.resize(dims);
+
+	const typename EuclidTypes<T>::FPVector step(0, 0, sampleSize);
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+		// A row in pieces of a block
+		const std::size_t blockSize = Structure<T>::blockSize;
+		bool in[Structure<T>::blockSize];
+#ifdef _OPENMP
+		#pragma omp for
+#endif
+		for (int x = 0; x < int(dimX); ++x)
+		for (std::size_t y = 0; y < dimY; ++y)
+		for (std::size_t z = 0; z < dimZ; z += blockSize)
+		{
+			const typename EuclidTypes<T>::FPPoint
+				 first( T(x)*sampleSize + deltaX,
+					T(y)*sampleSize + deltaY,
+					T(z)*sampleSize + deltaZ );
+			const std::size_t n = std::min(blockSize, dimZ - z);
+
+			shape.inside(first, step, in, n);
+			for (std::size_t i = 0; i < n; ++i)
+				voxels[x][y][z + i] = in[i] ? 1 : 0;
+		}
+	}
+
+	return true;
+}
+
+// The same as bits, each word of a row from one call to inside()
+template <typename S, typename T>
+bool convertToBitVoxels_(const S &shape, const T sampleSize, BitVoxels &voxels)
+{
+	if (shape.empty())
+	{
+		voxels.clear();
+		return true;
+	}
+
+	std::size_t dimX, dimY, dimZ;
+	T deltaX, deltaY, deltaZ;
+	calcShapeConsts(shape, sampleSize, dimX, dimY, dimZ,
+			deltaX, deltaY, deltaZ);
+
+	voxels.resize(dimX, dimY, dimZ);
+
+	const typename EuclidTypes<T>::FPVector step(0, 0, sampleSize);
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+		const std::size_t wordBits = BitVoxels::wordBits;
+		bool in[BitVoxels::wordBits];
+#ifdef _OPENMP
+		#pragma omp for
+#endif
+		for (int x = 0; x < int(dimX); ++x)
+		for (std::size_t y = 0; y < dimY; ++y)
+		{
+			BitVoxels::Word * const row = voxels.row(x, y);
+			for (std::size_t w = 0; w < voxels.rowWords(); ++w)
+			{
+				const std::size_t z = w * wordBits;
+				const typename EuclidTypes<T>::FPPoint
+					 first( T(x)*sampleSize + deltaX,
+						T(y)*sampleSize + deltaY,
+						T(z)*sampleSize + deltaZ );
+				const std::size_t n = std::min(wordBits, dimZ - z);
+
+				shape.inside(first, step, in, n);
+				BitVoxels::Word word = 0;
+				for (std::size_t i = 0; i < n; ++i)
+					word |= BitVoxels::Word(in[i]) << i;
+				row[w] = word;
+			}
+		}
+	}
+
+	return true;
+}
+
+// The changes of inside() along each row
+template <typename S, typename T>
+bool convertToSpanVoxels_(const S &shape, const T sampleSize, SpanVoxels &voxels)
+{
+	if (shape.empty())
+	{
+		voxels.clear();
+		return true;
+	}
+
+	std::size_t dimX, dimY, dimZ;
+	T deltaX, deltaY, deltaZ;
+	calcShapeConsts(shape, sampleSize, dimX, dimY, dimZ,
+			deltaX, deltaY, deltaZ);
+
+	voxels.resize(dimX, dimY, dimZ);
+
+	// Transitions per plane x; the starts of its columns are counted
+	// from the start of the plane first.
+	std::vector<std::vector<SpanVoxels::Index> > planes(dimX);
+	std::vector<std::size_t> &starts = voxels.starts();
+
+	const typename EuclidTypes<T>::FPVector step(0, 0, sampleSize);
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+		const std::size_t blockSize = Structure<T>::blockSize;
+		bool in[Structure<T>::blockSize];
+#ifdef _OPENMP
+		#pragma omp for
+#endif
+		for (int x = 0; x < int(dimX); ++x)
+		for (std::size_t y = 0; y < dimY; ++y)
+		{
+			std::vector<SpanVoxels::Index> &plane = planes[x];
+			bool prev = false;
+			for (std::size_t z = 0; z < dimZ; z += blockSize)
+			{
+				const typename EuclidTypes<T>::FPPoint
+					 first( T(x)*sampleSize + deltaX,
+						T(y)*sampleSize + deltaY,
+						T(z)*sampleSize + deltaZ );
+				const std::size_t n = std::min(blockSize, dimZ - z);
+
+				shape.inside(first, step, in, n);
+				for (std::size_t i = 0; i < n; ++i)
+					if (in[i] != prev)
+					{
+						plane.push_back(z + i);
+						prev = in[i];
+					}
+			}
+			if (prev)
+				plane.push_back(dimZ);
+
+			starts[x*dimY + y + 1] = plane.size();
+		}
+	}
+
+	std::size_t offset = 0;
+	for (std::size_t x = 0; x < dimX; ++x)
+	{
+		for (std::size_t y = 0; y < dimY; ++y)
+			starts[x*dimY + y + 1] += offset;
+		offset += planes[x].size();
+	}
+
+	voxels.transitions().resize(offset);
+#ifdef _OPENMP
+	#pragma omp parallel for
+#endif
+	for (int x = 0; x < int(dimX); ++x)
+	{
+		std::copy(planes[x].begin(), planes[x].end(),
+			  voxels.transitions().begin() + starts[x*dimY]);
+		std::vector<SpanVoxels::Index>().swap(planes[x]);
+	}
+
+	return true;
+}
+
+} // end namespace detail
+
 template <typename T, typename V>
 bool convertToVoxels(const Shape<T> &shape, const T sampleSize,
 		     cvmlcpp::Matrix<V, 3> &voxels)
 {
-	cvmlcpp::Matrix<T, 3> field;
-	return  convertToField(shape, sampleSize, field) &&
-		convertToVoxels(field, voxels);
+	return detail::convertToVoxels_(shape, sampleSize, voxels);
+}
+
+template <typename T, typename V>
+bool convertToVoxels(const CompiledShape<T> &shape, const T sampleSize,
+		     cvmlcpp::Matrix<V, 3> &voxels)
+{
+	return detail::convertToVoxels_(shape, sampleSize, voxels);
+}
+
+// One bit per voxel, see BitVoxels
+template <typename T>
+bool convertToVoxels(const Shape<T> &shape, const T sampleSize,
+		     BitVoxels &voxels)
+{
+	return detail::convertToBitVoxels_(shape, sampleSize, voxels);
+}
+
+template <typename T>
+bool convertToVoxels(const CompiledShape<T> &shape, const T sampleSize,
+		     BitVoxels &voxels)
+{
+	return detail::convertToBitVoxels_(shape, sampleSize, voxels);
+}
+
+// Unpack, for cvmlcpp's voxel formats
+template <typename V>
+bool convertToVoxels(const BitVoxels &bits, cvmlcpp::Matrix<V, 3> &voxels)
+{
+	const std::size_t dims [] = {bits.extent(X), bits.extent(Y), bits.extent(Z)};
+	voxels.resize(dims);
+
+#ifdef _OPENMP
+	#pragma omp parallel for
+#endif
+	for (int x = 0; x < int(dims[X]); ++x)
+	for (std::size_t y = 0; y < dims[Y]; ++y)
+	{
+		const BitVoxels::Word * const row = bits.row(x, y);
+		for (std::size_t z = 0; z < dims[Z]; ++z)
+			voxels[x][y][z] = (row[z / BitVoxels::wordBits] >>
+					   (z % BitVoxels::wordBits)) & 1u;
+	}
+
+	return true;
+}
+
+// Runs along the z-axis, see SpanVoxels
+template <typename T>
+bool convertToVoxels(const Shape<T> &shape, const T sampleSize,
+		     SpanVoxels &voxels)
+{
+	return detail::convertToSpanVoxels_(shape, sampleSize, voxels);
+}
+
+template <typename T>
+bool convertToVoxels(const CompiledShape<T> &shape, const T sampleSize,
+		     SpanVoxels &voxels)
+{
+	return detail::convertToSpanVoxels_(shape, sampleSize, voxels);
+}
+
+template <typename V>
+bool convertToVoxels(const SpanVoxels &spans, cvmlcpp::Matrix<V, 3> &voxels)
+{
+	const std::size_t dims [] = {spans.extent(X), spans.extent(Y), spans.extent(Z)};
+	voxels.resize(dims);
+	std::fill(voxels.begin(), voxels.end(), V(0));
+
+#ifdef _OPENMP
+	#pragma omp parallel for
+#endif
+	for (int x = 0; x < int(dims[X]); ++x)
+	for (std::size_t y = 0; y < dims[Y]; ++y)
+		for (const SpanVoxels::Index *t = spans.begin(x, y);
+		     t != spans.end(x, y); t += 2)
+			for (std::size_t z = t[0]; z < t[1]; ++z)
+				voxels[x][y][z] = 1;
+
+	return true;
+}
+
+inline bool convertToVoxels(const SpanVoxels &spans, BitVoxels &voxels)
+{
+	voxels.resize(spans.extent(X), spans.extent(Y), spans.extent(Z));
+
+#ifdef _OPENMP
+	#pragma omp parallel for
+#endif
+	for (int x = 0; x < int(spans.extent(X)); ++x)
+	for (std::size_t y = 0; y < spans.extent(Y); ++y)
+		for (const SpanVoxels::Index *t = spans.begin(x, y);
+		     t != spans.end(x, y); t += 2)
+			voxels.fill(x, y, t[0], t[1]);
+
+	return true;
 }
 
 namespace io {
@@ -69,9 +355,27 @@ bool exportVoxels(const std::string fileName, const cvmlcpp::Matrix<T, 3> &field
 template <typename T>
 bool exportVoxels(const std::string fileName, const Shape<T> &shape, const T sampleSize = T(1))
 {
-	cvmlcpp::Matrix<T, 3> field;
-	return  convertToField(shape, sampleSize, field) &&
-	 	exportVoxels(fileName, field);
+	cvmlcpp::Matrix<char, 3> voxels;
+	return  convertToVoxels(shape, sampleSize, voxels) &&
+		cvmlcpp::writeVoxels(voxels, fileName);
+}
+
+template <typename T>
+bool exportBitVoxels(const std::string fileName, const Shape<T> &shape,
+		     const T sampleSize = T(1))
+{
+	BitVoxels voxels;
+	return  convertToVoxels(shape, sampleSize, voxels) &&
+		writeBitVoxels(voxels, fileName);
+}
+
+template <typename T>
+bool exportSpanVoxels(const std::string fileName, const Shape<T> &shape,
+		      const T sampleSize = T(1))
+{
+	SpanVoxels voxels;
+	return  convertToVoxels(shape, sampleSize, voxels) &&
+		writeSpanVoxels(voxels, fileName);
 }
 
 }  // end namespace io
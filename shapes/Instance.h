@@ -0,0 +1,180 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_INSTANCE_H
+#define SHAPES_INSTANCE_H 1
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <tr1/memory>
+
+#include <shapes/Structure.h>
+
+namespace shapes
+{
+
+/*
+ * Named structures that Instances refer to, such as a bifurcation or a
+ * strut pattern used many times in a shape. Each is parsed once and
+ * shared by its instances, and must not be changed afterwards.
+ */
+template <typename T>
+class Definitions
+{
+	public:
+		typedef std::tr1::shared_ptr<const Structure<T> > Pointer;
+
+		// Parse the Definition elements under root, in order; a
+		// definition may use those before it.
+		bool fromXml(TiXmlHandle &root);
+
+		// Append a Definition element for each definition to root
+		void toXml(TiXmlElement * const root) const;
+
+		void print(unsigned indent) const;
+
+		// False if the name is already taken
+		bool add(const std::string &name, const Pointer &structure);
+
+		// Null if there is no such definition
+		Pointer find(const std::string &name) const;
+
+		void clear() { definitions.clear(); }
+
+		bool empty() const { return definitions.empty(); }
+
+		// While a Scope exists, Instances parsed by fromXML() look up
+		// their definition in the given Definitions.
+		class Scope
+		{
+			public:
+				Scope(const Definitions<T> &d) : previous(current_())
+				{ current_() = &d; }
+
+				~Scope() { current_() = previous; }
+
+			private:
+				const Definitions<T> * const previous;
+		};
+
+		static const Definitions<T> *current() { return current_(); }
+
+	private:
+		std::vector<std::pair<std::string, Pointer> > definitions;
+
+		static const Definitions<T> *&current_()
+		{
+			static const Definitions<T> *c = 0;
+			return c;
+		}
+};
+
+/*
+ * A definition placed in the shape: turned by 'angle' (radians) around
+ * the rotation vector, scaled by 'scale' and moved by 'translation'. The
+ * point is taken into the coordinates of the definition instead, so all
+ * instances share one structure.
+ */
+template <typename T>
+class Instance : public Structure<T>
+{
+	public:
+		typedef typename Structure<T>::FPPoint  FPPoint;
+		typedef typename Structure<T>::FPVector FPVector;
+		typedef typename Definitions<T>::Pointer Pointer;
+
+		Instance(const std::string name__ = "") : Structure<T>(name__)
+		{ this->setTransform(FPVector(0), FPVector(1, 0, 0), 0, 1); }
+
+		Instance(const std::string &_definitionName, const Pointer &_definition,
+			 const std::string name__ = "") :
+			Structure<T>(name__), definitionName(_definitionName),
+			definition(_definition)
+		{ this->setTransform(FPVector(0), FPVector(1, 0, 0), 0, 1); }
+
+		virtual ~Instance() { }
+
+		virtual bool fromXML(TiXmlHandle &root);
+
+		virtual TiXmlElement * const toXML() const;
+
+		virtual void getBoundingBox(FPPoint &_minCorner,
+					    FPPoint &_maxCorner) const;
+
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
+		virtual void print(unsigned int indent) const;
+
+		virtual T cost() const
+		{ return definition ? definition->cost() : T(1); }
+
+		bool setTransform(const FPVector &_translation, const FPVector &_rotVector,
+				  const T _angle, const T _scale);
+
+		const std::string &getDefinitionName() const { return definitionName; }
+
+		bool empty() const { return !definition; }
+
+	private:
+		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
+		virtual void rawInside(const FPPoint * const pts, bool * const out,
+				       const std::size_t n) const;
+
+		std::string definitionName;
+		Pointer definition;
+
+		FPVector translation, rotVector;
+		T angle, scale;
+
+		// Rotation back, divided by the scale
+		T inverse[3][3];
+
+		// The point in the coordinates of the definition, and back
+		FPPoint toLocal(const FPPoint &p) const
+		{
+			const FPVector v = p - translation;
+			FPPoint q;
+			for (unsigned i = 0; i < 3; ++i)
+				q[i] = inverse[i][X]*v[X] + inverse[i][Y]*v[Y] + inverse[i][Z]*v[Z];
+			return q;
+		}
+
+		FPPoint fromLocal(const FPPoint &q) const
+		{
+			const T s2 = scale * scale;
+			FPPoint p = translation;
+			for (unsigned i = 0; i < 3; ++i)
+				p[i] += s2 * (inverse[X][i]*q[X] + inverse[Y][i]*q[Y] + inverse[Z][i]*q[Z]);
+			return p;
+		}
+
+		// Box around the transformed box [lower, upper]
+		void transformBox(const FPPoint &lower, const FPPoint &upper,
+				  FPPoint &_minCorner, FPPoint &_maxCorner) const;
+};
+
+} // end namespace
+
+#include <shapes/Instance.hh>
+
+#endif
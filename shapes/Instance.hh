@@ -0,0 +1,488 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include <boost/lexical_cast.hpp>
+
+#include <shapes/Point.h>
+#include <shapes/Sphere.h>
+#include <shapes/SphereCloud.h>
+#include <shapes/Tube.h>
+#include <shapes/Union.h>
+#include <shapes/Intersection.h>
+#include <shapes/Difference.h>
+#include <shapes/Repeat.h>
+
+namespace shapes
+{
+
+template <typename T>
+bool Definitions<T>::fromXml(TiXmlHandle &root)
+{
+	unsigned count = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Definition").ToElement();
+	     elem; elem = elem->NextSiblingElement("Definition") )
+	{
+		++count;
+		TiXmlHandle	definitionHandle(elem);
+		TiXmlElement * nameElem = definitionHandle.FirstChildElement("Name").ToElement();
+		if (!nameElem || !nameElem->GetText())
+		{
+			std::cout << "Definition " << count << ": no Name." << std::endl;
+			return false;
+		}
+		const std::string name = nameElem->GetText();
+
+		// The one structure it defines, which may use earlier definitions
+		const Scope scope(*this);
+		Structure<T> * structure = 0;
+		for (TiXmlElement * child = definitionHandle.FirstChildElement().ToElement();
+		     child; child = child->NextSiblingElement() )
+		{
+			const std::string tag = child->Value();
+			Structure<T> * s = 0;
+			if (tag == "Sphere")
+				s = new Sphere<T>();
+			else if (tag == "SphereCloud")
+				s = new SphereCloud<T>();
+			else if (tag == "Tube")
+				s = new Tube<T>();
+			else if (tag == "Union")
+				s = new Union<T>();
+			else if (tag == "Intersection")
+				s = new Intersection<T>();
+			else if (tag == "Difference")
+				s = new Difference<T>();
+			else if (tag == "Repeat")
+				s = new Repeat<T>();
+			else if (tag == "Instance")
+				s = new Instance<T>();
+			else
+				continue;
+
+			TiXmlHandle	handle(child);
+			if (structure != 0 || !s->fromXML(handle))
+			{
+				std::cout << "Definition \"" << name << "\": parse failure "
+					<< tag << ", there must be one single valid structure."
+					<< std::endl;
+				delete s;
+				delete structure;
+				return false;
+			}
+			structure = s;
+		}
+
+		if (structure == 0 || !this->add(name, Pointer(structure)))
+		{
+			std::cout << "Definition \"" << name << "\": "
+				<< (structure ? "name already defined." : "no structure.")
+				<< std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+template <typename T>
+void Definitions<T>::toXml(TiXmlElement * const root) const
+{
+	for (typename std::vector<std::pair<std::string, Pointer> >::const_iterator
+	     i = definitions.begin(); i != definitions.end(); ++i)
+	{
+		TiXmlElement * const definitionElem = new TiXmlElement("Definition");
+
+		TiXmlElement * const nameElem = new TiXmlElement("Name");
+		nameElem->LinkEndChild( new TiXmlText(i->first.c_str()) );
+		definitionElem->LinkEndChild(nameElem);
+
+		definitionElem->LinkEndChild( i->second->toXML() );
+		root->LinkEndChild(definitionElem);
+	}
+}
+
+template <typename T>
+void Definitions<T>::print(unsigned indent) const
+{
+	for (typename std::vector<std::pair<std::string, Pointer> >::const_iterator
+	     i = definitions.begin(); i != definitions.end(); ++i)
+	{
+		for (unsigned j = 0; j < indent; ++j)
+			std::cout << "\t";
+		std::cout << "<Definition>" << std::endl;
+
+		for (unsigned j = 0; j <= indent; ++j)
+			std::cout << "\t";
+		std::cout << "<Name>" << i->first << "</Name>" << std::endl;
+
+		i->second->print(indent + 1);
+
+		for (unsigned j = 0; j < indent; ++j)
+			std::cout << "\t";
+		std::cout << "</Definition>" << std::endl;
+	}
+}
+
+template <typename T>
+bool Definitions<T>::add(const std::string &name, const Pointer &structure)
+{
+	if (!structure || this->find(name))
+		return false;
+	definitions.push_back(std::make_pair(name, structure));
+
+	return true;
+}
+
+template <typename T>
+typename Definitions<T>::Pointer Definitions<T>::find(const std::string &name) const
+{
+	for (typename std::vector<std::pair<std::string, Pointer> >::const_iterator
+	     i = definitions.begin(); i != definitions.end(); ++i)
+		if (i->first == name)
+			return i->second;
+
+	return Pointer();
+}
+
+template <typename T>
+bool Instance<T>::setTransform(const FPVector &_translation, const FPVector &_rotVector,
+			       const T _angle, const T _scale)
+{
+	const T length = cvmlcpp::modulus(_rotVector);
+	if (!(length > T(0)) || !(_scale > T(0)))
+		return false;
+
+	FPVector orientation[3];
+	if (!Point<T>::recomputeOrientation(_rotVector / length, _angle, orientation))
+		return false;
+
+	translation = _translation;
+	rotVector = _rotVector / length;
+	angle = _angle;
+	scale = _scale;
+	for (unsigned i = 0; i < 3; ++i)
+	for (unsigned j = 0; j < 3; ++j)
+		inverse[i][j] = orientation[i][j] / scale;
+
+	return true;
+}
+
+template <typename T>
+T Instance<T>::rawValue(const FPPoint &p) const
+{
+	return definition ? definition->value(this->toLocal(p)) : T(0);
+}
+
+template <typename T>
+void Instance<T>::rawValues(const FPPoint * const pts, T * const out,
+			    const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+	if (!definition)
+	{
+		std::fill(out, out + n, T(0));
+		return;
+	}
+
+	FPPoint q[Structure<T>::blockSize];
+	for (std::size_t i = 0; i < n; ++i)
+		q[i] = this->toLocal(pts[i]);
+	definition->values(q, out, n);
+}
+
+template <typename T>
+void Instance<T>::rawInside(const FPPoint * const pts, bool * const out,
+			    const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+	if (!definition)
+	{
+		std::fill(out, out + n, false);
+		return;
+	}
+
+	FPPoint q[Structure<T>::blockSize];
+	for (std::size_t i = 0; i < n; ++i)
+		q[i] = this->toLocal(pts[i]);
+	definition->inside(q, out, n);
+}
+
+template <typename T>
+void Instance<T>::transformBox(const FPPoint &lower, const FPPoint &upper,
+			       FPPoint &_minCorner, FPPoint &_maxCorner) const
+{
+	_minCorner =  std::numeric_limits<T>::max();
+	_maxCorner = -std::numeric_limits<T>::max();
+	for (unsigned corner = 0; corner < 8u; ++corner)
+	{
+		FPPoint q;
+		for (unsigned d = 0; d < 3; ++d)
+			q[d] = (corner & (1u << d)) ? upper[d] : lower[d];
+		const FPPoint p = this->fromLocal(q);
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			_minCorner[d] = std::min(_minCorner[d], p[d]);
+			_maxCorner[d] = std::max(_maxCorner[d], p[d]);
+		}
+	}
+}
+
+template <typename T>
+void Instance<T>::getBoundingBox(FPPoint &_minCorner, FPPoint &_maxCorner) const
+{
+	if (!definition)
+	{
+		_minCorner =  std::numeric_limits<T>::max();
+		_maxCorner = -std::numeric_limits<T>::max();
+		return;
+	}
+
+	FPPoint lower, upper;
+	definition->getBoundingBox(lower, upper);
+	this->transformBox(lower, upper, _minCorner, _maxCorner);
+}
+
+template <typename T>
+bool Instance<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	FPPoint localLower, localUpper;
+	if (!definition || !definition->getSupport(localLower, localUpper))
+		return false;
+
+	this->transformBox(localLower, localUpper, lower, upper);
+
+	return true;
+}
+
+template <typename T>
+bool Instance<T>::fromXML(TiXmlHandle &root)
+{
+	using boost::lexical_cast;
+
+	this->setName("");
+	TiXmlElement * elem = root.FirstChildElement("Name").ToElement();
+	if (elem)
+		this->setName(elem->GetText());
+
+	if ( (elem = root.FirstChildElement("DampLow").ToElement()) )
+		this->dampLow = lexical_cast<T>(elem->GetText());
+
+	if ( (elem = root.FirstChildElement("DampHigh").ToElement()) )
+		this->dampHigh = lexical_cast<T>(elem->GetText());
+
+	elem = root.FirstChildElement("Definition").ToElement();
+	definitionName = (elem && elem->GetText()) ? elem->GetText() : "";
+	const Definitions<T> * const definitions = Definitions<T>::current();
+	definition = definitions ? definitions->find(definitionName) : Pointer();
+	if (!definition)
+	{
+		std::cout << "Instance"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": no Definition \"" << definitionName << "\"." << std::endl;
+		return false;
+	}
+
+	FPVector _translation = 0;
+	if ( (elem = root.FirstChildElement("Translation").ToElement()) )
+	{
+		std::stringstream stranslation(elem->GetText());
+		stranslation >> _translation.x();
+		stranslation >> _translation.y();
+		stranslation >> _translation.z();
+	}
+
+	FPVector _rotVector(1, 0, 0);
+	T _angle = 0;
+	if ( (elem = root.FirstChildElement("Orientation").ToElement()) )
+	{
+		TiXmlHandle orientationHandle(elem);
+		TiXmlElement * vecElem =
+			orientationHandle.FirstChildElement("RotationVector").ToElement();
+		TiXmlElement * angleElem =
+			orientationHandle.FirstChildElement("Angle").ToElement();
+		if (!vecElem || !angleElem)
+		{
+			std::cout << "Instance"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": Orientation needs a RotationVector and an Angle." << std::endl;
+			return false;
+		}
+		std::stringstream sorientation(vecElem->GetText());
+		sorientation >> _rotVector.x();
+		sorientation >> _rotVector.y();
+		sorientation >> _rotVector.z();
+
+		// Convert degrees to radians
+		_angle = cvmlcpp::Constants<T>::pi() * lexical_cast<T>(angleElem->GetText()) / T(180);
+	}
+
+	T _scale = 1;
+	if ( (elem = root.FirstChildElement("Scale").ToElement()) )
+		_scale = lexical_cast<T>(elem->GetText());
+
+	if (!this->setTransform(_translation, _rotVector, _angle, _scale))
+	{
+		std::cout << "Instance"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": RotationVector must not be zero and Scale must be "
+			<< "greater than zero." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+template <typename T>
+TiXmlElement * const Instance<T>::toXML() const
+{
+	using boost::lexical_cast;
+
+	TiXmlElement * const root = new TiXmlElement("Instance");
+
+	std::string buf;
+
+	if (!this->name().empty())
+	{
+		TiXmlElement * const nameElem = new TiXmlElement("Name");
+		nameElem->LinkEndChild( new TiXmlText(this->name().c_str()) );
+		root->LinkEndChild(nameElem);
+	}
+
+	TiXmlElement * const definitionElem = new TiXmlElement("Definition");
+	definitionElem->LinkEndChild( new TiXmlText(definitionName.c_str()) );
+	root->LinkEndChild(definitionElem);
+
+	buf =   lexical_cast<std::string>(translation.x())+" " +
+		lexical_cast<std::string>(translation.y())+" " +
+		lexical_cast<std::string>(translation.z());
+	TiXmlElement * const translationElem = new TiXmlElement("Translation");
+	translationElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+	root->LinkEndChild(translationElem);
+
+	if (angle != 0)
+	{
+		TiXmlElement * const orientationElem = new TiXmlElement("Orientation");
+
+		buf =   lexical_cast<std::string>(rotVector.x())+" " +
+			lexical_cast<std::string>(rotVector.y())+" " +
+			lexical_cast<std::string>(rotVector.z());
+		TiXmlElement * const vecElem = new TiXmlElement("RotationVector");
+		vecElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		orientationElem->LinkEndChild(vecElem);
+
+		// Convert radians to degrees!!
+		buf = lexical_cast<std::string>(T(180) * angle / cvmlcpp::Constants<T>::pi());
+		TiXmlElement * const angleElem = new TiXmlElement("Angle");
+		angleElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		orientationElem->LinkEndChild(angleElem);
+
+		root->LinkEndChild(orientationElem);
+	}
+
+	if (scale != 1)
+	{
+		buf = lexical_cast<std::string>(scale);
+		TiXmlElement * const scaleElem = new TiXmlElement("Scale");
+		scaleElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(scaleElem);
+	}
+
+	if (this->dampLow != 1)
+	{
+		buf = lexical_cast<std::string>(this->dampLow);
+		TiXmlElement * const dampLowElem = new TiXmlElement("DampLow");
+		dampLowElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(dampLowElem);
+	}
+
+	if (this->dampHigh != 1)
+	{
+		buf = lexical_cast<std::string>(this->dampHigh);
+		TiXmlElement * const dampHighElem = new TiXmlElement("DampHigh");
+		dampHighElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(dampHighElem);
+	}
+
+	return root;
+}
+
+template <typename T>
+void Instance<T>::print(unsigned indent) const
+{
+	using boost::lexical_cast;
+
+	Structure<T>::printIndented("<Instance>", indent);
+	std::string buf;
+
+	if (!this->name().empty())
+	{
+		buf = "<Name>"+this->name()+"</Name>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	buf = "<Definition>"+definitionName+"</Definition>";
+	Structure<T>::printIndented(buf, indent + 1);
+
+	buf = "<Translation>" +
+		lexical_cast<std::string>(translation.x())+" " +
+		lexical_cast<std::string>(translation.y())+" " +
+		lexical_cast<std::string>(translation.z())+"</Translation>";
+	Structure<T>::printIndented(buf, indent + 1);
+
+	if (angle != 0)
+	{
+		buf = "<Orientation><RotationVector>" +
+			lexical_cast<std::string>(rotVector.x())+" " +
+			lexical_cast<std::string>(rotVector.y())+" " +
+			lexical_cast<std::string>(rotVector.z())+"</RotationVector><Angle>" +
+			lexical_cast<std::string>(T(180) * angle / cvmlcpp::Constants<T>::pi()) +
+			"</Angle></Orientation>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (scale != 1)
+	{
+		buf = "<Scale>"+lexical_cast<std::string>(scale)+"</Scale>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (this->dampLow != 1)
+	{
+		buf = "<DampLow>"+lexical_cast<std::string>(this->dampLow)+"</DampLow>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (this->dampHigh != 1)
+	{
+		buf = "<DampHigh>"+lexical_cast<std::string>(this->dampHigh)+"</DampHigh>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	Structure<T>::printIndented("</Instance>\n", indent);
+}
+
+} // end namespace
@@ -23,6 +23,7 @@
 
 #include <vector>
 #include <shapes/Structure.h>
+#include <shapes/Power.h>
 
 namespace shapes
 {
@@ -35,10 +36,12 @@ class Intersection : public Structure<T>
 		typedef typename Structure<T>::FPVector FPVector;
 
 		Intersection(const std::string name__ = "", T _exponent = 2.) :
-			Structure<T>(name__), exponent(_exponent) { }
+			Structure<T>(name__), exponent(_exponent)
+		{ this->setPowers(); }
 
 		Intersection(T _exponent, const std::string name__ = "") :
-			Structure<T>(name__), exponent(_exponent) { }
+			Structure<T>(name__), exponent(_exponent)
+		{ this->setPowers(); }
 
 		virtual ~Intersection();
 
@@ -69,8 +72,15 @@ class Intersection : public Structure<T>
 			}
 		}
 
+		// The overlap of the supports of the structures that have one
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
 		virtual void print(unsigned int indent) const;
 
+		virtual void compile(CompiledShape<T> &compiled, const unsigned slot) const;
+
+		virtual T cost() const;
+
 		void add(Structure<T> *structure);
 
 		void clear();
@@ -79,8 +89,24 @@ class Intersection : public Structure<T>
 
 	private:
 		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
+		virtual void rawInside(const FPPoint * const pts, bool * const out,
+				       const std::size_t n) const;
 		T exponent;
+
+		// x^-exponent and x^(-1/exponent)
+		Power<T> power, root;
+
+		void setPowers()
+		{
+			power.set(-exponent);
+			root.set(T(-1) / exponent);
+		}
 		std::vector<Structure<T> *> structures;
+
+		// Pairs of cost and index of the structures, cheapest first
+		std::vector<std::pair<T, std::size_t> > order;
 };
 
 } // end namespace
@@ -24,9 +24,13 @@
 #include <boost/lexical_cast.hpp>
 
 #include <shapes/Sphere.h>
+#include <shapes/SphereCloud.h>
+#include <shapes/Repeat.h>
+#include <shapes/Instance.h>
 #include <shapes/Tube.h>
 #include <shapes/Union.h>
 #include <shapes/Difference.h>
+#include <shapes/CompiledShape.h>
 
 namespace shapes
 {
@@ -45,6 +49,7 @@ void Intersection<T>::clear()
 		delete *i;
 
 	structures.clear();
+	order.clear();
 	this->setName("");
 }
 
@@ -52,6 +57,8 @@ template <typename T>
 void Intersection<T>::add(Structure<T> *structure)
 {
 	structures.push_back(structure);
+	const std::pair<T, std::size_t> entry(structure->cost(), structures.size() - 1u);
+	order.insert(std::upper_bound(order.begin(), order.end(), entry), entry);
 }
 
 template <typename T>
@@ -61,9 +68,127 @@ T Intersection<T>::rawValue(const FPPoint &p) const
 
 	for (typename std::vector<Structure<T> *>::const_iterator i = structures.begin();
 	     i != structures.end(); ++i)
-		val += std::pow( (*i)->value(p), -exponent );
+		val += power( (*i)->value(p) );
 
-	return std::pow( val, T(-1)/exponent );
+	return root(val);
+}
+
+template <typename T>
+void Intersection<T>::rawValues(const FPPoint * const pts, T * const out,
+				const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+	T childValues[Structure<T>::blockSize];
+
+	std::fill(out, out + n, T(0.0));
+	for (typename std::vector<Structure<T> *>::const_iterator i = structures.begin();
+	     i != structures.end(); ++i)
+	{
+		(*i)->values(pts, childValues, n);
+		for (std::size_t j = 0; j < n; ++j)
+			out[j] += power(childValues[j]);
+	}
+
+	for (std::size_t j = 0; j < n; ++j)
+		out[j] = root(out[j]);
+}
+
+template <typename T>
+bool Intersection<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	// A vanishing structure makes the sum of powers infinite, and
+	// the intersection zero, provided that the exponent is positive.
+	if (!(exponent > T(0)))
+		return false;
+
+	bool found = false;
+	lower = -std::numeric_limits<T>::max();
+	upper =  std::numeric_limits<T>::max();
+	for (typename std::vector<Structure<T> *>::const_iterator i = structures.begin();
+	     i != structures.end(); ++i)
+	{
+		FPPoint l, u;
+		if (!(*i)->getSupport(l, u))
+			continue;
+		found = true;
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::max(lower[d], l[d]);
+			upper[d] = std::min(upper[d], u[d]);
+		}
+	}
+
+	return found;
+}
+
+template <typename T>
+T Intersection<T>::cost() const
+{
+	T c = 1;
+	for (typename std::vector<Structure<T> *>::const_iterator i = structures.begin();
+	     i != structures.end(); ++i)
+		c += (*i)->cost();
+
+	return c;
+}
+
+template <typename T>
+void Intersection<T>::rawInside(const FPPoint * const pts, bool * const out,
+				const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+
+	// Points not yet decided, their index in the block, and the sum
+	// for each so far
+	FPPoint rest[Structure<T>::blockSize];
+	std::size_t index[Structure<T>::blockSize];
+	T sums[Structure<T>::blockSize];
+	T childValues[Structure<T>::blockSize];
+	std::size_t m = n;
+	for (std::size_t j = 0; j < n; ++j)
+	{
+		rest[j]  = pts[j];
+		index[j] = j;
+		sums[j]  = 0;
+	}
+
+	// The intersection is at most as large as each of its children
+	for (std::size_t k = 0; k < order.size() && m > 0u; ++k)
+	{
+		structures[order[k].second]->values(rest, childValues, m);
+
+		std::size_t kept = 0;
+		for (std::size_t j = 0; j < m; ++j)
+		{
+			if (childValues[j] < T(1))
+			{
+				out[index[j]] = false;
+				continue;
+			}
+			rest[kept]  = rest[j];
+			index[kept] = index[j];
+			sums[kept]  = sums[j] + power(childValues[j]);
+			++kept;
+		}
+		m = kept;
+	}
+
+	for (std::size_t j = 0; j < m; ++j)
+		out[index[j]] = root(sums[j]) >= T(1);
+}
+
+template <typename T>
+void Intersection<T>::compile(CompiledShape<T> &compiled, const unsigned slot) const
+{
+	compiled.emitClear(slot);
+	for (typename std::vector<Structure<T> *>::const_iterator i = structures.begin();
+	     i != structures.end(); ++i)
+	{
+		(*i)->compile(compiled, slot + 1);
+		compiled.emitAccumulate(slot, slot + 1, -exponent);
+	}
+	compiled.emitFinish(slot, T(-1) / exponent);
+	this->compileDamping(compiled, slot);
 }
 
 template <typename T>
@@ -86,6 +211,7 @@ bool Intersection<T>::fromXML(TiXmlHandle &root)
 			<< ": Exponent parse failure, Exponent not greater than zero." << std::endl;
 		return false;
 	}
+	this->setPowers();
 
 	if ( (elem = root.FirstChildElement("DampLow").ToElement()) )
 		this->dampLow = lexical_cast<T>(elem->GetText());
@@ -112,6 +238,63 @@ bool Intersection<T>::fromXML(TiXmlHandle &root)
 		structures.push_back(sphere);
 	}
 
+	unsigned int sphereClouds = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("SphereCloud").ToElement();
+	     elem; elem = elem->NextSiblingElement("SphereCloud") )
+	{
+		++sphereClouds;
+		SphereCloud<T> * cloud = new SphereCloud<T>();
+		TiXmlHandle	handle(elem);
+		if (!cloud->fromXML(handle))
+		{
+			std::cout << "Intersection"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure SphereCloud "
+				<< sphereClouds << "." << std::endl;
+			return false;
+		}
+
+		structures.push_back(cloud);
+	}
+
+	unsigned int repeats = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Repeat").ToElement();
+	     elem; elem = elem->NextSiblingElement("Repeat") )
+	{
+		++repeats;
+		Repeat<T> * repeat = new Repeat<T>();
+		TiXmlHandle	handle(elem);
+		if (!repeat->fromXML(handle))
+		{
+			std::cout << "Intersection"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure Repeat "
+				<< repeats << "." << std::endl;
+			return false;
+		}
+
+		structures.push_back(repeat);
+	}
+
+	unsigned int instances = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Instance").ToElement();
+	     elem; elem = elem->NextSiblingElement("Instance") )
+	{
+		++instances;
+		Instance<T> * instance = new Instance<T>();
+		TiXmlHandle	handle(elem);
+		if (!instance->fromXML(handle))
+		{
+			std::cout << "Intersection"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure Instance "
+				<< instances << "." << std::endl;
+			return false;
+		}
+
+		structures.push_back(instance);
+	}
+
 	unsigned int tubes = 0;
 	for (TiXmlElement * elem = root.FirstChildElement("Tube").ToElement();
 	     elem; elem = elem->NextSiblingElement("Tube") )
@@ -188,6 +371,8 @@ bool Intersection<T>::fromXML(TiXmlHandle &root)
 		structures.push_back(_difference);
 	}
 
+	Structure<T>::orderByCost(structures, order);
+
 	return true;
 }
 
@@ -32,7 +32,7 @@ Point<T>::Point(const FPPoint &_center, const FPVector &_weight,
 		const T _R,
 		const FPVector _rotVector, const T _angle,
 		const T _exponent) :
-	center(_center), weight(_weight), R(_R), rotVector(_rotVector), angle(_angle), exponent(_exponent)
+	center(_center), weight(_weight), rotVector(_rotVector), R(_R), angle(_angle), exponent(_exponent)
 {
 	assert(cvmlcpp::modulus(weight) > 0.);
 	assert(cvmlcpp::modulus(rotVector) > 0.);
@@ -0,0 +1,207 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_POWER_H
+#define SHAPES_POWER_H 1
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include <shapes/Simd.h>
+
+namespace shapes
+{
+
+/*
+ * x^e for a fixed exponent e. Multiples of 1/4 up to maxExponent in magnitude
+ * are computed with multiplications, square roots and a reciprocal instead of
+ * std::pow(); the result differs from std::pow() by a few ULP at most.
+ */
+template <typename T>
+class Power
+{
+	public:
+		static const unsigned maxExponent = 8;
+
+		Power(const T e = 1) { this->set(e); }
+
+		void set(const T e)
+		{
+			e_ = e;
+			reciprocal = (e < T(0));
+
+			const T a = std::abs(e);
+			const T quarters = a * T(4);
+			if (a <= T(maxExponent) && quarters == std::floor(quarters))
+			{
+				integer  = static_cast<unsigned>(std::floor(a));
+				fraction = static_cast<Fraction>(static_cast<unsigned>(quarters) % 4u);
+			}
+			else
+				fraction = GENERIC;
+		}
+
+		T exponent() const { return e_; }
+
+		// Computed without std::pow() ?
+		bool specialized() const { return fraction != GENERIC; }
+
+		T operator()(const T x) const
+		{
+			T y;
+			switch (fraction)
+			{
+				case ZERO:    y = this->integerPower(x); break;
+				case QUARTER: y = this->integerPower(x) * std::sqrt(std::sqrt(x)); break;
+				case HALF:    y = this->integerPower(x) * std::sqrt(x); break;
+				case THREE_QUARTERS:
+				{
+					const T r = std::sqrt(x);
+					y = this->integerPower(x) * (r * std::sqrt(r));
+					break;
+				}
+				default: return std::pow(x, e_);
+			}
+			return reciprocal ? T(1) / y : y;
+		}
+
+		// operator() for n values, where x and y may be the same. The
+		// cases are told apart once, outside the loops, so that these
+		// vectorize; the results are the same.
+		SHAPES_TARGET_CLONES
+		void operator()(const T * const x, T * const y, const std::size_t n) const
+		{
+			if (fraction == GENERIC)
+			{
+				SHAPES_SIMD
+				for (std::size_t i = 0; i < n; ++i)
+					y[i] = std::pow(x[i], e_);
+				return;
+			}
+
+			const std::size_t chunk = 64;
+			T b[chunk], f[chunk];
+			for (std::size_t i = 0; i < n; i += chunk)
+			{
+				const std::size_t m = std::min(chunk, n - i);
+				const T * const xi = x + i;
+				T * const yi = y + i;
+
+				// Fractional power, and the base of integerPower(),
+				// before x may be overwritten
+				switch (fraction)
+				{
+					case QUARTER:
+						SHAPES_SIMD
+						for (std::size_t j = 0; j < m; ++j)
+							f[j] = std::sqrt(std::sqrt(xi[j]));
+						break;
+					case HALF:
+						SHAPES_SIMD
+						for (std::size_t j = 0; j < m; ++j)
+							f[j] = std::sqrt(xi[j]);
+						break;
+					case THREE_QUARTERS:
+						SHAPES_SIMD
+						for (std::size_t j = 0; j < m; ++j)
+						{
+							const T r = std::sqrt(xi[j]);
+							f[j] = r * std::sqrt(r);
+						}
+						break;
+					default:
+						break;
+				}
+				SHAPES_SIMD
+				for (std::size_t j = 0; j < m; ++j)
+					b[j] = xi[j];
+
+				// integerPower()
+				if (integer & 1u)
+				{
+					SHAPES_SIMD
+					for (std::size_t j = 0; j < m; ++j)
+						yi[j] = b[j];
+				}
+				else
+				{
+					SHAPES_SIMD
+					for (std::size_t j = 0; j < m; ++j)
+						yi[j] = T(1);
+				}
+				for (unsigned k = integer >> 1; k; k >>= 1)
+				{
+					SHAPES_SIMD
+					for (std::size_t j = 0; j < m; ++j)
+						b[j] *= b[j];
+					if (k & 1u)
+					{
+						SHAPES_SIMD
+						for (std::size_t j = 0; j < m; ++j)
+							yi[j] *= b[j];
+					}
+				}
+
+				if (fraction != ZERO)
+				{
+					SHAPES_SIMD
+					for (std::size_t j = 0; j < m; ++j)
+						yi[j] *= f[j];
+				}
+				if (reciprocal)
+				{
+					SHAPES_SIMD
+					for (std::size_t j = 0; j < m; ++j)
+						yi[j] = T(1) / yi[j];
+				}
+			}
+		}
+
+	private:
+		// Fractional part of |e| in quarters
+		enum Fraction { ZERO, QUARTER, HALF, THREE_QUARTERS, GENERIC };
+
+		T e_;
+		unsigned integer;
+		Fraction fraction;
+		bool reciprocal;
+
+		// x^integer by repeated squaring
+		T integerPower(const T x) const
+		{
+			T y = (integer & 1u) ? x : T(1);
+			T b = x;
+			for (unsigned k = integer >> 1; k; k >>= 1)
+			{
+				b *= b;
+				if (k & 1u)
+					y *= b;
+			}
+			return y;
+		}
+};
+
+template <typename T>
+const unsigned Power<T>::maxExponent;
+
+} // end namespace
+
+#endif
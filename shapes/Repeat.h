@@ -0,0 +1,162 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_REPEAT_H
+#define SHAPES_REPEAT_H 1
+
+#include <vector>
+
+#include <shapes/Structure.h>
+#include <shapes/Power.h>
+
+namespace shapes
+{
+
+/*
+ * The Union of copies of one structure, such as the struts of a stent or
+ * the cells of a lattice: either moved along one to three vectors, a
+ * number of times each, or turned around an axis, optionally moving along
+ * it on each turn for a helix. If the structure has a support, a point
+ * only visits the copies whose support it lies in, which follow from its
+ * position relative to the lattice or the axis; otherwise all copies are
+ * evaluated.
+ */
+template <typename T>
+class Repeat : public Structure<T>
+{
+	public:
+		typedef typename Structure<T>::FPPoint  FPPoint;
+		typedef typename Structure<T>::FPVector FPVector;
+
+		Repeat(const std::string name__ = "", T _exponent = 2.) :
+			Structure<T>(name__), structure(0), exponent(_exponent),
+			mode(translation), count(0), angle(0), pitch(0), bounded(false)
+		{ this->setPowers(); }
+
+		Repeat(T _exponent, const std::string name__ = "") :
+			Structure<T>(name__), structure(0), exponent(_exponent),
+			mode(translation), count(0), angle(0), pitch(0), bounded(false)
+		{ this->setPowers(); }
+
+		virtual ~Repeat() { this->clear(); }
+
+		virtual bool fromXML(TiXmlHandle &root);
+
+		virtual TiXmlElement * const toXML() const;
+
+		virtual void getBoundingBox(FPPoint &_minCorner,
+					    FPPoint &_maxCorner) const;
+
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
+		virtual void print(unsigned int indent) const;
+
+		virtual T cost() const;
+
+		// The structure to repeat; do _not_ delete it yourself!! Call
+		// one of the set functions below after changing it.
+		void set(Structure<T> * const _structure);
+
+		// Copies at k_0 vectors[0] + k_1 vectors[1] + ..., for
+		// 0 <= k_i < counts[i]; one to three linearly independent
+		// vectors.
+		bool setTranslations(const std::vector<FPVector> &_vectors,
+				     const std::vector<std::size_t> &_counts);
+
+		// Copies turned k times by 'angle' (radians) around 'axis'
+		// through 'center', and moved k times 'pitch' along it, for
+		// 0 <= k < count.
+		bool setRotation(const FPPoint &_center, const FPVector &_axis,
+				 const std::size_t _count, const T _angle,
+				 const T _pitch = 0);
+
+		void clear();
+
+		std::size_t copies() const;
+
+		bool empty() const { return structure == 0; }
+
+	private:
+		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
+
+		Structure<T> *structure;
+		T exponent;
+
+		// x^exponent and x^(1/exponent)
+		Power<T> power, root;
+
+		void setPowers()
+		{
+			power.set(exponent);
+			root.set(T(1) / exponent);
+		}
+
+		enum Mode { translation, rotation };
+		Mode mode;
+
+		// Translations, and the inverse of the vectors completed to a
+		// basis: the coordinates of an offset in the lattice
+		std::vector<FPVector> vectors;
+		std::vector<std::size_t> counts;
+		T inverse[3][3];
+
+		// Rotation, and the matrix that turns copy k back, for each k
+		FPPoint center;
+		FPVector axis;
+		std::size_t count;
+		T angle, pitch;
+		struct Matrix { T m[3][3]; };
+		std::vector<Matrix> turns;
+
+		// Support of the structure, if bounded; for rotations also
+		// its range of angles around the axis, unless it surrounds the
+		// axis, and its range along the axis. Angles are measured from
+		// 'reference', perpendicular to the axis.
+		bool bounded;
+		FPPoint supportLower, supportUpper;
+		bool surrounds;
+		T angleLow, angleHigh, heightLow, heightHigh;
+		FPVector reference;
+
+		// Update the above after a change
+		void update();
+
+		// The point p in the frame of copy k, and back
+		FPPoint toCopy(const std::size_t k, const FPPoint &p) const;
+		FPPoint fromCopy(const std::size_t k, const FPPoint &q) const;
+
+		// Copies of which p may lie in the support, by increasing k
+		void candidates(const FPPoint &p, std::vector<std::size_t> &ks) const;
+
+		// Box around the copies of the box [lower, upper]
+		void copiesBox(const FPPoint &lower, const FPPoint &upper,
+			       FPPoint &_minCorner, FPPoint &_maxCorner) const;
+
+		// Angle of p around the axis
+		T angleOf(const FPPoint &p) const;
+};
+
+} // end namespace
+
+#include <shapes/Repeat.hh>
+
+#endif
@@ -0,0 +1,840 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <utility>
+
+#include <boost/lexical_cast.hpp>
+
+#include <shapes/Sphere.h>
+#include <shapes/SphereCloud.h>
+#include <shapes/Tube.h>
+#include <shapes/Union.h>
+#include <shapes/Intersection.h>
+#include <shapes/Difference.h>
+#include <shapes/Instance.h>
+
+namespace shapes
+{
+
+namespace detail
+{
+
+// Two unit vectors perpendicular to v and to each other
+template <typename T>
+void perpendiculars(const typename EuclidTypes<T>::FPVector &v,
+		    typename EuclidTypes<T>::FPVector &a,
+		    typename EuclidTypes<T>::FPVector &b)
+{
+	unsigned smallest = 0;
+	for (unsigned d = 1; d < 3; ++d)
+		if (std::abs(v[d]) < std::abs(v[smallest]))
+			smallest = d;
+
+	typename EuclidTypes<T>::FPVector e = 0;
+	e[smallest] = 1;
+	a = cvmlcpp::crossProduct(v, e);
+	a /= cvmlcpp::modulus(a);
+	b = cvmlcpp::crossProduct(v, a);
+	b /= cvmlcpp::modulus(b);
+}
+
+} // end namespace detail
+
+template <typename T>
+void Repeat<T>::clear()
+{
+	delete structure;
+	structure = 0;
+	mode = translation;
+	vectors.clear();
+	counts.clear();
+	turns.clear();
+	bounded = false;
+	this->setName("");
+}
+
+template <typename T>
+void Repeat<T>::set(Structure<T> * const _structure)
+{
+	if (structure != _structure)
+		delete structure;
+	structure = _structure;
+	this->update();
+}
+
+template <typename T>
+bool Repeat<T>::setTranslations(const std::vector<FPVector> &_vectors,
+				const std::vector<std::size_t> &_counts)
+{
+	if (_vectors.empty() || _vectors.size() > 3u || _vectors.size() != _counts.size())
+		return false;
+	for (std::size_t i = 0; i < _counts.size(); ++i)
+		if (_counts[i] == 0u)
+			return false;
+
+	// Complete the vectors to a basis
+	FPVector basis[3];
+	for (std::size_t i = 0; i < _vectors.size(); ++i)
+		basis[i] = _vectors[i];
+	if (_vectors.size() == 1u)
+		detail::perpendiculars<T>(basis[0], basis[1], basis[2]);
+	else if (_vectors.size() == 2u)
+		basis[2] = cvmlcpp::crossProduct(basis[0], basis[1]);
+
+	// Inverse of the matrix with the basis as columns, by cofactors
+	const FPVector c0 = cvmlcpp::crossProduct(basis[1], basis[2]);
+	const FPVector c1 = cvmlcpp::crossProduct(basis[2], basis[0]);
+	const FPVector c2 = cvmlcpp::crossProduct(basis[0], basis[1]);
+	const T det = cvmlcpp::dotProduct(basis[0], c0);
+	if (!(std::abs(det) > T(0)))
+		return false;
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		inverse[0][d] = c0[d] / det;
+		inverse[1][d] = c1[d] / det;
+		inverse[2][d] = c2[d] / det;
+	}
+
+	mode = translation;
+	vectors = _vectors;
+	counts = _counts;
+	turns.clear();
+	this->update();
+
+	return true;
+}
+
+template <typename T>
+bool Repeat<T>::setRotation(const FPPoint &_center, const FPVector &_axis,
+			    const std::size_t _count, const T _angle, const T _pitch)
+{
+	const T length = cvmlcpp::modulus(_axis);
+	if (!(length > T(0)) || _count == 0u)
+		return false;
+
+	mode = rotation;
+	center = _center;
+	axis = _axis / length;
+	count = _count;
+	angle = _angle;
+	pitch = _pitch;
+	vectors.clear();
+	counts.clear();
+
+	// Rodrigues: turn back by k * angle
+	turns.resize(count);
+	for (std::size_t k = 0; k < count; ++k)
+	{
+		const T a = -T(k) * angle;
+		const T c = std::cos(a), s = std::sin(a);
+		const T u[3] = { axis[X], axis[Y], axis[Z] };
+		T (&m)[3][3] = turns[k].m;
+		for (unsigned i = 0; i < 3; ++i)
+		for (unsigned j = 0; j < 3; ++j)
+			m[i][j] = (i == j ? c : T(0)) + (T(1) - c) * u[i] * u[j];
+		m[X][Y] -= s * u[Z]; m[Y][X] += s * u[Z];
+		m[X][Z] += s * u[Y]; m[Z][X] -= s * u[Y];
+		m[Y][Z] -= s * u[X]; m[Z][Y] += s * u[X];
+	}
+	this->update();
+
+	return true;
+}
+
+template <typename T>
+std::size_t Repeat<T>::copies() const
+{
+	if (mode == rotation)
+		return count;
+
+	std::size_t n = 1u;
+	for (std::size_t i = 0; i < counts.size(); ++i)
+		n *= counts[i];
+
+	return n;
+}
+
+template <typename T>
+void Repeat<T>::update()
+{
+	bounded = structure && exponent > T(0) &&
+		  structure->getSupport(supportLower, supportUpper);
+	if (!bounded || mode != rotation)
+		return;
+
+	FPVector other;
+	detail::perpendiculars<T>(axis, reference, other);
+
+	heightLow  =  std::numeric_limits<T>::max();
+	heightHigh = -std::numeric_limits<T>::max();
+	for (unsigned corner = 0; corner < 8u; ++corner)
+	{
+		FPPoint p;
+		for (unsigned d = 0; d < 3; ++d)
+			p[d] = (corner & (1u << d)) ? supportUpper[d] : supportLower[d];
+		const T h = cvmlcpp::dotProduct(p - center, axis);
+		heightLow  = std::min(heightLow,  h);
+		heightHigh = std::max(heightHigh, h);
+	}
+
+	// The box is within a ball; if that does not reach the axis, the
+	// angles it covers are within asin(radius / distance) of its center.
+	const FPPoint middle = (supportLower + supportUpper) / T(2);
+	const T radius = cvmlcpp::modulus(supportUpper - supportLower) / T(2);
+	FPVector toMiddle = middle - center;
+	toMiddle -= axis * cvmlcpp::dotProduct(toMiddle, axis);
+	const T distance = cvmlcpp::modulus(toMiddle);
+	surrounds = !(distance > radius);
+	if (!surrounds)
+	{
+		const T half = std::asin(radius / distance);
+		angleLow  = this->angleOf(middle) - half;
+		angleHigh = this->angleOf(middle) + half;
+	}
+}
+
+template <typename T>
+T Repeat<T>::angleOf(const FPPoint &p) const
+{
+	const FPVector v = p - center;
+	return std::atan2(cvmlcpp::dotProduct(v, cvmlcpp::crossProduct(axis, reference)),
+			  cvmlcpp::dotProduct(v, reference));
+}
+
+template <typename T>
+typename Repeat<T>::FPPoint Repeat<T>::toCopy(const std::size_t k, const FPPoint &p) const
+{
+	if (mode == rotation)
+	{
+		const FPVector v = p - center - axis * (T(k) * pitch);
+		const T (&m)[3][3] = turns[k].m;
+		FPPoint q;
+		for (unsigned i = 0; i < 3; ++i)
+			q[i] = center[i] + m[i][X]*v[X] + m[i][Y]*v[Y] + m[i][Z]*v[Z];
+		return q;
+	}
+
+	FPPoint q = p;
+	std::size_t rest = k;
+	for (std::size_t i = 0; i < vectors.size(); ++i)
+	{
+		q -= vectors[i] * T(rest % counts[i]);
+		rest /= counts[i];
+	}
+
+	return q;
+}
+
+template <typename T>
+typename Repeat<T>::FPPoint Repeat<T>::fromCopy(const std::size_t k, const FPPoint &q) const
+{
+	if (mode == rotation)
+	{
+		const FPVector v = q - center;
+		const T (&m)[3][3] = turns[k].m;
+		FPPoint p;
+		for (unsigned i = 0; i < 3; ++i)
+			p[i] = center[i] + m[X][i]*v[X] + m[Y][i]*v[Y] + m[Z][i]*v[Z];
+		return p + axis * (T(k) * pitch);
+	}
+
+	FPPoint p = q;
+	std::size_t rest = k;
+	for (std::size_t i = 0; i < vectors.size(); ++i)
+	{
+		p += vectors[i] * T(rest % counts[i]);
+		rest /= counts[i];
+	}
+
+	return p;
+}
+
+template <typename T>
+void Repeat<T>::candidates(const FPPoint &p, std::vector<std::size_t> &ks) const
+{
+	ks.clear();
+	if (!bounded)
+	{
+		for (std::size_t k = 0; k < this->copies(); ++k)
+			ks.push_back(k);
+		return;
+	}
+
+	if (mode == translation)
+	{
+		// Lattice coordinates of the offsets that move the support
+		// over p, within those of the corners of their box
+		T low[3], high[3];
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			low[i]  =  std::numeric_limits<T>::max();
+			high[i] = -std::numeric_limits<T>::max();
+		}
+		for (unsigned corner = 0; corner < 8u; ++corner)
+		{
+			FPVector offset;
+			for (unsigned d = 0; d < 3; ++d)
+				offset[d] = p[d] - ((corner & (1u << d)) ?
+						supportLower[d] : supportUpper[d]);
+			for (unsigned i = 0; i < 3; ++i)
+			{
+				const T k = inverse[i][X]*offset[X] + inverse[i][Y]*offset[Y] +
+					    inverse[i][Z]*offset[Z];
+				low[i]  = std::min(low[i],  k);
+				high[i] = std::max(high[i], k);
+			}
+		}
+
+		std::size_t from[3] = { 0u, 0u, 0u }, to[3] = { 0u, 0u, 0u };
+		for (std::size_t i = 0; i < vectors.size(); ++i)
+		{
+			const T lo = std::max(T(0), std::ceil(low[i]));
+			const T hi = std::min(T(counts[i] - 1u), std::floor(high[i]));
+			if (lo > hi)
+				return;
+			from[i] = static_cast<std::size_t>(lo);
+			to[i]   = static_cast<std::size_t>(hi);
+		}
+
+		const std::size_t c0 = counts[0];
+		const std::size_t c1 = (counts.size() > 1u) ? counts[1] : 1u;
+		for (std::size_t k2 = from[2]; k2 <= to[2]; ++k2)
+		for (std::size_t k1 = from[1]; k1 <= to[1]; ++k1)
+		for (std::size_t k0 = from[0]; k0 <= to[0]; ++k0)
+			ks.push_back(k0 + c0 * (k1 + c1 * k2));
+		return;
+	}
+
+	// Rotation; the copies that reach the height of p
+	T kLow = 0, kHigh = T(count - 1u);
+	if (pitch != T(0))
+	{
+		const T h = cvmlcpp::dotProduct(p - center, axis);
+		const T a = (h - heightHigh) / pitch;
+		const T b = (h - heightLow)  / pitch;
+		kLow  = std::max(kLow,  std::ceil (std::min(a, b)));
+		kHigh = std::min(kHigh, std::floor(std::max(a, b)));
+	}
+	if (kLow > kHigh)
+		return;
+	const std::size_t from = static_cast<std::size_t>(kLow);
+	const std::size_t to   = static_cast<std::size_t>(kHigh);
+
+	if (surrounds)
+	{
+		for (std::size_t k = from; k <= to; ++k)
+			ks.push_back(k);
+		return;
+	}
+
+	// Of those, the ones turned towards p: k * angle is within
+	// [phi - angleHigh, phi - angleLow] up to whole turns.
+	const T twoPi = T(2) * cvmlcpp::Constants<T>::pi();
+	const T phi = this->angleOf(p);
+	if (angle == T(0))
+	{
+		const T mid = T(0.5) * (angleLow + angleHigh);
+		const T d = phi - mid - twoPi * std::floor((phi - mid) / twoPi + T(0.5));
+		if (std::abs(d) <= T(0.5) * (angleHigh - angleLow))
+			for (std::size_t k = from; k <= to; ++k)
+				ks.push_back(k);
+		return;
+	}
+
+	const T turnedLow  = std::min(T(from) * angle, T(to) * angle);
+	const T turnedHigh = std::max(T(from) * angle, T(to) * angle);
+	const T mLow  = std::ceil ((turnedLow  - (phi - angleLow))  / twoPi);
+	const T mHigh = std::floor((turnedHigh - (phi - angleHigh)) / twoPi);
+	for (T m = mLow; m <= mHigh; ++m)
+	{
+		const T a = (phi - angleHigh + twoPi * m) / angle;
+		const T b = (phi - angleLow  + twoPi * m) / angle;
+		const T lo = std::max(T(from), std::ceil (std::min(a, b)));
+		const T hi = std::min(T(to),   std::floor(std::max(a, b)));
+		for (T k = lo; k <= hi; ++k)
+			ks.push_back(static_cast<std::size_t>(k));
+	}
+	std::sort(ks.begin(), ks.end());
+	ks.erase(std::unique(ks.begin(), ks.end()), ks.end());
+}
+
+template <typename T>
+T Repeat<T>::rawValue(const FPPoint &p) const
+{
+	T val;
+	this->rawValues(&p, &val, 1u);
+	return val;
+}
+
+template <typename T>
+void Repeat<T>::rawValues(const FPPoint * const pts, T * const out,
+			  const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+
+	std::fill(out, out + n, T(0.0));
+	if (structure == 0)
+		return;
+
+	// Pairs of copy and point, for points in the support of the copy
+	std::vector<std::pair<std::size_t, std::size_t> > visits;
+	std::vector<std::size_t> ks;
+	for (std::size_t j = 0; j < n; ++j)
+	{
+		this->candidates(pts[j], ks);
+		for (std::vector<std::size_t>::const_iterator k = ks.begin();
+		     k != ks.end(); ++k)
+			visits.push_back(std::make_pair(*k, j));
+	}
+	std::sort(visits.begin(), visits.end());
+
+	// Each copy for its points at once; each point sums its copies in
+	// increasing order, as a Union would.
+	FPPoint q[Structure<T>::blockSize];
+	std::size_t index[Structure<T>::blockSize];
+	T values[Structure<T>::blockSize];
+	for (std::size_t v = 0; v < visits.size(); )
+	{
+		const std::size_t k = visits[v].first;
+		std::size_t m = 0;
+		for (; v < visits.size() && visits[v].first == k; ++v)
+		{
+			const FPPoint p = this->toCopy(k, pts[visits[v].second]);
+			if (bounded && !detail::boxesOverlap<T>(p, p, supportLower, supportUpper))
+				continue;
+			q[m] = p;
+			index[m++] = visits[v].second;
+		}
+
+		structure->values(q, values, m);
+		for (std::size_t j = 0; j < m; ++j)
+			out[index[j]] += power(values[j]);
+	}
+
+	for (std::size_t j = 0; j < n; ++j)
+		out[j] = root(out[j]);
+}
+
+template <typename T>
+void Repeat<T>::copiesBox(const FPPoint &lower, const FPPoint &upper,
+			  FPPoint &_minCorner, FPPoint &_maxCorner) const
+{
+	if (mode == translation)
+	{
+		_minCorner = lower;
+		_maxCorner = upper;
+		for (std::size_t i = 0; i < vectors.size(); ++i)
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				const T last = T(counts[i] - 1u) * vectors[i][d];
+				_minCorner[d] += std::min(T(0), last);
+				_maxCorner[d] += std::max(T(0), last);
+			}
+		return;
+	}
+
+	_minCorner =  std::numeric_limits<T>::max();
+	_maxCorner = -std::numeric_limits<T>::max();
+	for (std::size_t k = 0; k < count; ++k)
+		for (unsigned corner = 0; corner < 8u; ++corner)
+		{
+			FPPoint q;
+			for (unsigned d = 0; d < 3; ++d)
+				q[d] = (corner & (1u << d)) ? upper[d] : lower[d];
+			const FPPoint p = this->fromCopy(k, q);
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				_minCorner[d] = std::min(_minCorner[d], p[d]);
+				_maxCorner[d] = std::max(_maxCorner[d], p[d]);
+			}
+		}
+}
+
+template <typename T>
+void Repeat<T>::getBoundingBox(FPPoint &_minCorner, FPPoint &_maxCorner) const
+{
+	if (structure == 0)
+	{
+		_minCorner =  std::numeric_limits<T>::max();
+		_maxCorner = -std::numeric_limits<T>::max();
+		return;
+	}
+
+	FPPoint lower, upper;
+	structure->getBoundingBox(lower, upper);
+	this->copiesBox(lower, upper, _minCorner, _maxCorner);
+}
+
+template <typename T>
+bool Repeat<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	if (!bounded)
+		return false;
+
+	this->copiesBox(supportLower, supportUpper, lower, upper);
+
+	return true;
+}
+
+template <typename T>
+T Repeat<T>::cost() const
+{
+	if (structure == 0)
+		return T(1);
+
+	// A point is in the support of a few copies at most
+	if (bounded)
+		return T(1) + T(2) * structure->cost();
+
+	return T(1) + T(this->copies()) * structure->cost();
+}
+
+template <typename T>
+bool Repeat<T>::fromXML(TiXmlHandle &root)
+{
+	using boost::lexical_cast;
+
+	this->clear();
+
+	TiXmlElement * elem = root.FirstChildElement("Name").ToElement();
+	if (elem)
+		this->setName(elem->GetText());
+
+	if ( (elem = root.FirstChildElement("Exponent").ToElement()) )
+		this->exponent = lexical_cast<T>(elem->GetText());
+	if (!(exponent > T(0)))
+	{
+		std::cout << "Repeat"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": Exponent parse failure, Exponent not greater than zero." << std::endl;
+		return false;
+	}
+	this->setPowers();
+
+	if ( (elem = root.FirstChildElement("DampLow").ToElement()) )
+		this->dampLow = lexical_cast<T>(elem->GetText());
+
+	if ( (elem = root.FirstChildElement("DampHigh").ToElement()) )
+		this->dampHigh = lexical_cast<T>(elem->GetText());
+
+	// The one structure to repeat
+	for (TiXmlElement * elem = root.FirstChildElement().ToElement();
+	     elem; elem = elem->NextSiblingElement() )
+	{
+		const std::string tag = elem->Value();
+		Structure<T> * child = 0;
+		if (tag == "Sphere")
+			child = new Sphere<T>();
+		else if (tag == "SphereCloud")
+			child = new SphereCloud<T>();
+		else if (tag == "Tube")
+			child = new Tube<T>();
+		else if (tag == "Union")
+			child = new Union<T>();
+		else if (tag == "Intersection")
+			child = new Intersection<T>();
+		else if (tag == "Difference")
+			child = new Difference<T>();
+		else if (tag == "Repeat")
+			child = new Repeat<T>();
+		else if (tag == "Instance")
+			child = new Instance<T>();
+		else
+			continue;
+
+		TiXmlHandle	handle(elem);
+		if (structure != 0 || !child->fromXML(handle))
+		{
+			std::cout << "Repeat"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure " << tag << ", there must be "
+				<< "one single valid structure." << std::endl;
+			delete child;
+			return false;
+		}
+		structure = child;
+	}
+	if (structure == 0)
+	{
+		std::cout << "Repeat"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": no structure to repeat." << std::endl;
+		return false;
+	}
+
+	std::vector<FPVector> _vectors;
+	std::vector<std::size_t> _counts;
+	for (TiXmlElement * elem = root.FirstChildElement("Translation").ToElement();
+	     elem; elem = elem->NextSiblingElement("Translation") )
+	{
+		TiXmlHandle	handle(elem);
+		TiXmlElement * vectorElem = handle.FirstChildElement("Vector").ToElement();
+		TiXmlElement * countElem  = handle.FirstChildElement("Count").ToElement();
+		if (!vectorElem || !countElem)
+		{
+			std::cout << "Repeat"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": Translation needs a Vector and a Count." << std::endl;
+			return false;
+		}
+
+		FPVector v;
+		std::stringstream svector(vectorElem->GetText());
+		svector >> v.x();
+		svector >> v.y();
+		svector >> v.z();
+		_vectors.push_back(v);
+		_counts.push_back(lexical_cast<std::size_t>(countElem->GetText()));
+	}
+
+	TiXmlElement * rotationElem = root.FirstChildElement("Rotation").ToElement();
+	if (rotationElem && !_vectors.empty())
+	{
+		std::cout << "Repeat"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": either Translations or a Rotation, not both." << std::endl;
+		return false;
+	}
+
+	if (rotationElem)
+	{
+		TiXmlHandle	handle(rotationElem);
+		TiXmlElement * centerElem = handle.FirstChildElement("Center").ToElement();
+		TiXmlElement * axisElem   = handle.FirstChildElement("Axis").ToElement();
+		TiXmlElement * countElem  = handle.FirstChildElement("Count").ToElement();
+		if (!centerElem || !axisElem || !countElem)
+		{
+			std::cout << "Repeat"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": Rotation needs a Center, an Axis and a Count." << std::endl;
+			return false;
+		}
+
+		FPPoint _center;
+		std::stringstream scenter(centerElem->GetText());
+		scenter >> _center.x();
+		scenter >> _center.y();
+		scenter >> _center.z();
+
+		FPVector _axis;
+		std::stringstream saxis(axisElem->GetText());
+		saxis >> _axis.x();
+		saxis >> _axis.y();
+		saxis >> _axis.z();
+
+		const std::size_t _count = lexical_cast<std::size_t>(countElem->GetText());
+
+		// In degrees, by default a full turn in equal steps
+		T _angle = _count ? T(360) / T(_count) : T(0);
+		if ( (elem = handle.FirstChildElement("Angle").ToElement()) )
+			_angle = lexical_cast<T>(elem->GetText());
+		_angle *= cvmlcpp::Constants<T>::pi() / T(180);
+
+		T _pitch = 0;
+		if ( (elem = handle.FirstChildElement("Pitch").ToElement()) )
+			_pitch = lexical_cast<T>(elem->GetText());
+
+		if (!this->setRotation(_center, _axis, _count, _angle, _pitch))
+		{
+			std::cout << "Repeat"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": Rotation parse failure, Axis must not be zero "
+				<< "and Count must be positive." << std::endl;
+			return false;
+		}
+	}
+	else if (!this->setTranslations(_vectors, _counts))
+	{
+		std::cout << "Repeat"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": one to three independent Translations with positive "
+			<< "Counts, or a Rotation, required." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+template <typename T>
+TiXmlElement * const Repeat<T>::toXML() const
+{
+	using boost::lexical_cast;
+
+	TiXmlElement * const root = new TiXmlElement("Repeat");
+
+	std::string buf;
+
+	if (!this->name().empty())
+	{
+		TiXmlElement * const nameElem = new TiXmlElement("Name");
+		nameElem->LinkEndChild( new TiXmlText(this->name().c_str()) );
+		root->LinkEndChild(nameElem);
+	}
+
+	buf = lexical_cast<std::string>(this->exponent);
+	TiXmlElement * const exponentElem = new TiXmlElement("Exponent");
+	exponentElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+	root->LinkEndChild(exponentElem);
+
+	if (this->dampLow != 1)
+	{
+		buf = lexical_cast<std::string>(this->dampLow);
+		TiXmlElement * const dampLowElem = new TiXmlElement("DampLow");
+		dampLowElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(dampLowElem);
+	}
+
+	if (this->dampHigh != 1)
+	{
+		buf = lexical_cast<std::string>(this->dampHigh);
+		TiXmlElement * const dampHighElem = new TiXmlElement("DampHigh");
+		dampHighElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(dampHighElem);
+	}
+
+	for (std::size_t i = 0; i < vectors.size(); ++i)
+	{
+		TiXmlElement * const translationElem = new TiXmlElement("Translation");
+
+		buf =   lexical_cast<std::string>(vectors[i].x())+" " +
+			lexical_cast<std::string>(vectors[i].y())+" " +
+			lexical_cast<std::string>(vectors[i].z());
+		TiXmlElement * const vectorElem = new TiXmlElement("Vector");
+		vectorElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		translationElem->LinkEndChild(vectorElem);
+
+		buf = lexical_cast<std::string>(counts[i]);
+		TiXmlElement * const countElem = new TiXmlElement("Count");
+		countElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		translationElem->LinkEndChild(countElem);
+
+		root->LinkEndChild(translationElem);
+	}
+
+	if (mode == rotation)
+	{
+		TiXmlElement * const rotationElem = new TiXmlElement("Rotation");
+
+		buf =   lexical_cast<std::string>(center.x())+" " +
+			lexical_cast<std::string>(center.y())+" " +
+			lexical_cast<std::string>(center.z());
+		TiXmlElement * const centerElem = new TiXmlElement("Center");
+		centerElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		rotationElem->LinkEndChild(centerElem);
+
+		buf =   lexical_cast<std::string>(axis.x())+" " +
+			lexical_cast<std::string>(axis.y())+" " +
+			lexical_cast<std::string>(axis.z());
+		TiXmlElement * const axisElem = new TiXmlElement("Axis");
+		axisElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		rotationElem->LinkEndChild(axisElem);
+
+		buf = lexical_cast<std::string>(count);
+		TiXmlElement * const countElem = new TiXmlElement("Count");
+		countElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		rotationElem->LinkEndChild(countElem);
+
+		// Convert radians to degrees!!
+		buf = lexical_cast<std::string>(T(180) * angle / cvmlcpp::Constants<T>::pi());
+		TiXmlElement * const angleElem = new TiXmlElement("Angle");
+		angleElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		rotationElem->LinkEndChild(angleElem);
+
+		if (pitch != 0)
+		{
+			buf = lexical_cast<std::string>(pitch);
+			TiXmlElement * const pitchElem = new TiXmlElement("Pitch");
+			pitchElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+			rotationElem->LinkEndChild(pitchElem);
+		}
+
+		root->LinkEndChild(rotationElem);
+	}
+
+	if (structure != 0)
+		root->LinkEndChild( structure->toXML() );
+
+	return root;
+}
+
+template <typename T>
+void Repeat<T>::print(unsigned indent) const
+{
+	using boost::lexical_cast;
+
+	Structure<T>::printIndented("<Repeat>", indent);
+	std::string buf;
+
+	if (this->dampLow != 1)
+	{
+		buf = "<DampLow>"+lexical_cast<std::string>(this->dampLow)+"</DampLow>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (this->dampHigh != 1)
+	{
+		buf = "<DampHigh>"+lexical_cast<std::string>(this->dampHigh)+"</DampHigh>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (!this->name().empty())
+	{
+		buf = "<Name>"+this->name()+"</Name>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	for (std::size_t i = 0; i < vectors.size(); ++i)
+	{
+		buf = "<Translation><Vector>" +
+			lexical_cast<std::string>(vectors[i].x())+" " +
+			lexical_cast<std::string>(vectors[i].y())+" " +
+			lexical_cast<std::string>(vectors[i].z())+"</Vector><Count>" +
+			lexical_cast<std::string>(counts[i])+"</Count></Translation>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (mode == rotation)
+	{
+		buf = "<Rotation><Center>" +
+			lexical_cast<std::string>(center.x())+" " +
+			lexical_cast<std::string>(center.y())+" " +
+			lexical_cast<std::string>(center.z())+"</Center><Axis>" +
+			lexical_cast<std::string>(axis.x())+" " +
+			lexical_cast<std::string>(axis.y())+" " +
+			lexical_cast<std::string>(axis.z())+"</Axis><Count>" +
+			lexical_cast<std::string>(count)+"</Count><Angle>" +
+			lexical_cast<std::string>(T(180) * angle / cvmlcpp::Constants<T>::pi()) +
+			"</Angle><Pitch>"+lexical_cast<std::string>(pitch)+"</Pitch></Rotation>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (structure != 0)
+		structure->print(indent + 1);
+
+	Structure<T>::printIndented("</Repeat>\n", indent);
+}
+
+} // end namespace
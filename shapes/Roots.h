@@ -0,0 +1,220 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_ROOTS_H
+#define SHAPES_ROOTS_H 1
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace shapes
+{
+
+namespace detail
+{
+
+// p(t) and p'(t) for p(t) = a[0] + a[1] t + ... + a[N] t^N
+template <std::size_t N, typename T>
+void evaluatePolynomial(const T * const a, const T t, T &p, T &dp)
+{
+	p  = a[N];
+	dp = T(0);
+	for (std::size_t i = N; i-- > 0; )
+	{
+		dp = dp * t + p;
+		p  = p  * t + a[i];
+	}
+}
+
+// Sign changes in the Bernstein coefficients b, ignoring zeros
+template <std::size_t N, typename T>
+unsigned signChanges(const T * const b)
+{
+	unsigned changes = 0;
+	int sign = 0;
+	for (std::size_t i = 0; i <= N; ++i)
+	{
+		const int s = (b[i] > T(0)) ? 1 : ((b[i] < T(0)) ? -1 : 0);
+		if (s != 0)
+		{
+			if (sign != 0 && s != sign)
+				++changes;
+			sign = s;
+		}
+	}
+	return changes;
+}
+
+// Root of p in (lo, hi), where p(lo) and p(hi) differ in sign: Newton
+// iterations from 'start', falling back to bisection when leaving the bracket.
+template <std::size_t N, typename T>
+T polishRoot(const T * const a, T lo, T hi, const bool rising, const T start)
+{
+	const unsigned maxIterations = 64;
+	const T tolerance = 4 * std::numeric_limits<T>::epsilon();
+
+	T t = (start > lo && start < hi) ? start : T(0.5) * (lo + hi);
+	for (unsigned i = 0; i < maxIterations; ++i)
+	{
+		T p, dp;
+		evaluatePolynomial<N>(a, t, p, dp);
+		if (p == T(0))
+			break;
+
+		if ( (p < T(0)) == rising )
+			lo = t;
+		else
+			hi = t;
+
+		T next = t - p / dp;
+		if (!(next > lo && next < hi)) // Also catches dp == 0
+			next = T(0.5) * (lo + hi);
+
+		const bool converged = std::abs(next - t) <= tolerance || hi - lo <= tolerance;
+		t = next;
+		if (converged)
+			break;
+	}
+
+	return t;
+}
+
+// Isolate the roots in [lo, hi], where the polynomial has Bernstein
+// coefficients b, by subdivision.
+template <std::size_t N, typename T>
+void isolateRoots(const T * const a, const T * const b, const T lo, const T hi,
+		  const T hint, const unsigned depth, T * const roots, std::size_t &nRoots)
+{
+	// Enough to resolve roots to the precision of T
+	const unsigned maxDepth = std::numeric_limits<T>::digits;
+
+	// A zero end coefficient is a root at that end. One at 'lo' was
+	// recorded as the end of the interval before, except at the start.
+	if (depth == 0 && b[0] == T(0) && nRoots < N)
+		roots[nRoots++] = lo;
+
+	// Sign changes count the roots strictly inside
+	const unsigned changes = signChanges<N>(b);
+	if (changes == 0 || nRoots == N || (changes > 1 && depth == maxDepth))
+	{
+		// Multiple root, or roots too close to separate
+		if (changes > 1 && nRoots < N)
+			roots[nRoots++] = T(0.5) * (lo + hi);
+		if (b[N] == T(0) && nRoots < N)
+			roots[nRoots++] = hi;
+		return;
+	}
+
+	if (changes == 1)
+	{
+		// Sign of p just after lo
+		std::size_t first = 0;
+		while (b[first] == T(0))
+			++first;
+		roots[nRoots++] = polishRoot<N>(a, lo, hi, b[first] < T(0), hint);
+		if (b[N] == T(0) && nRoots < N)
+			roots[nRoots++] = hi;
+		return;
+	}
+
+	// de Casteljau subdivision at the midpoint
+	T left[N+1], right[N+1], c[N+1];
+	for (std::size_t i = 0; i <= N; ++i)
+		c[i] = b[i];
+	for (std::size_t j = 0; j <= N; ++j)
+	{
+		left[j]    = c[0];
+		right[N-j] = c[N-j];
+		for (std::size_t i = 0; i < N-j; ++i)
+			c[i] = T(0.5) * (c[i] + c[i+1]);
+	}
+
+	const T mid = T(0.5) * (lo + hi);
+	isolateRoots<N>(a, left,  lo,  mid, hint, depth + 1, roots, nRoots);
+	isolateRoots<N>(a, right, mid, hi,  hint, depth + 1, roots, nRoots);
+}
+
+// Change of basis from powers to Bernstein polynomials on [0, 1]:
+// b[k] = sum_{i<=k} m[k][i] a[i], with m[k][i] = (k choose i)/(N choose i).
+template <std::size_t N, typename T>
+struct BernsteinBasis
+{
+	T m[N+1][N+1];
+
+	BernsteinBasis()
+	{
+		for (std::size_t k = 0; k <= N; ++k)
+		{
+			T kChooseI = T(1), nChooseI = T(1);
+			for (std::size_t i = 0; i <= N; ++i)
+			{
+				m[k][i] = (i <= k) ? kChooseI / nChooseI : T(0);
+				kChooseI *= T(k >= i ? k - i : 0) / T(i + 1);
+				nChooseI *= T(N - i) / T(i + 1);
+			}
+		}
+	}
+
+	static const BernsteinBasis &instance()
+	{
+		static const BernsteinBasis basis;
+		return basis;
+	}
+};
+
+} // end namespace detail
+
+/*
+ * Real roots in [0, 1] of p(t) = a[0] + a[1] t + ... + a[N] t^N; returns their
+ * number, at most N, and writes them to 'roots' in increasing order.
+ *
+ * In the Bernstein basis, the number of sign changes of the coefficients
+ * bounds the number of roots. Intervals with more than one sign change are
+ * split in two until each root is isolated; isolated roots are then found
+ * with safeguarded Newton iterations. Zero coefficients at the ends of an
+ * interval are roots there. Multiple roots are reported once. Nothing is
+ * allocated on the heap.
+ *
+ * If a root is expected near 'hint', e.g. the root found for a neighbouring
+ * point, the Newton iterations in its interval start there.
+ */
+template <std::size_t N, typename T>
+std::size_t unitIntervalRoots(const T * const a, T * const roots, const T hint = T(-1))
+{
+	// Bernstein coefficients
+	const detail::BernsteinBasis<N, T> &basis = detail::BernsteinBasis<N, T>::instance();
+	T b[N+1];
+	for (std::size_t k = 0; k <= N; ++k)
+	{
+		b[k] = a[0];
+		for (std::size_t i = 1; i <= k; ++i)
+			b[k] += basis.m[k][i] * a[i];
+	}
+
+	std::size_t nRoots = 0;
+	detail::isolateRoots<N>(a, b, T(0), T(1), hint, 0u, roots, nRoots);
+
+	return nRoots;
+}
+
+} // end namespace
+
+#endif
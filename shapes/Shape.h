@@ -30,6 +30,9 @@
 namespace shapes
 {
 
+template <typename T>
+class Definitions;
+
 template <typename T>
 class Shape
 {
@@ -37,7 +40,8 @@ class Shape
 		typedef typename Structure<T>::FPPoint  FPPoint;
 		typedef typename Structure<T>::FPVector FPVector;
 
-		Shape() : boxCached(false), boxSet(false) { }
+		Shape() : boxCached(false), boxSet(false),
+			definitions_(new Definitions<T>()) { }
 
 		bool fromXml(TiXmlDocument &doc);
 
@@ -49,6 +53,13 @@ class Shape
 
 		bool empty() const { return structure_ == NULL; }
 
+		std::tr1::shared_ptr<const Structure<T> > structure() const
+		{ return structure_; }
+
+		// Structures that Instances in the shape refer to
+		Definitions<T> &definitions() { return *definitions_; }
+		const Definitions<T> &definitions() const { return *definitions_; }
+
 		void getBoundingBox(FPPoint &_minCorner,
 				    FPPoint &_maxCorner) const;
 
@@ -70,19 +81,62 @@ class Shape
 		T value(const FPPoint &p) const
 		{ return this->empty() ? 0.0 : structure_-> value(p); }
 
+		void values(const FPPoint * const pts, T * const out,
+			    const std::size_t n) const
+		{
+			if (this->empty())
+				std::fill(out, out + n, T(0.0));
+			else
+				structure_->values(pts, out, n);
+		}
+
+		// Evaluate n points on a grid row: first, first + step, ...
+		void values(const FPPoint &first, const FPVector &step,
+			    T * const out, const std::size_t n) const
+		{
+			if (this->empty())
+				std::fill(out, out + n, T(0.0));
+			else
+				structure_->values(first, step, out, n);
+		}
+
+		// Whether value(p) >= 1, see Structure<T>::inside()
+		bool inside(const FPPoint &p) const
+		{ return this->empty() ? false : structure_->inside(p); }
+
+		void inside(const FPPoint * const pts, bool * const out,
+			    const std::size_t n) const
+		{
+			if (this->empty())
+				std::fill(out, out + n, false);
+			else
+				structure_->inside(pts, out, n);
+		}
+
+		void inside(const FPPoint &first, const FPVector &step,
+			    bool * const out, const std::size_t n) const
+		{
+			if (this->empty())
+				std::fill(out, out + n, false);
+			else
+				structure_->inside(first, step, out, n);
+		}
+
 	private:
 		mutable FPPoint minCorner, maxCorner;
 		mutable bool boxCached;
 		bool boxSet;
 		std::tr1::shared_ptr<Structure<T> > structure_;
+		std::tr1::shared_ptr<Definitions<T> > definitions_;
 };
 
-template <typename T>
-void calcShapeConsts(const Shape<T> &shape, const T sampleSize,
+// Works for Shape<T> and CompiledShape<T>
+template <typename S, typename T>
+void calcShapeConsts(const S &shape, const T sampleSize,
 		std::size_t &dimX, std::size_t &dimY, std::size_t &dimZ,
 		T &deltaX, T &deltaY, T &deltaZ)
 {
-	typename Shape<T>::FPPoint minCorner, maxCorner;
+	typename EuclidTypes<T>::FPPoint minCorner, maxCorner;
 	shape.getBoundingBox(minCorner, maxCorner);
 
 // std::cout << "MinCorner "; minCorner.print(); std::cout << std::endl;
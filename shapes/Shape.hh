@@ -25,10 +25,13 @@
 
 #include <shapes/Shape.h>
 #include <shapes/Sphere.h>
+#include <shapes/SphereCloud.h>
 #include <shapes/Tube.h>
 #include <shapes/Union.h>
 #include <shapes/Intersection.h>
 #include <shapes/Difference.h>
+#include <shapes/Repeat.h>
+#include <shapes/Instance.h>
 
 namespace shapes
 {
@@ -45,6 +48,8 @@ TiXmlDocument * const Shape<T>::toXml() const
 	TiXmlElement * root = new TiXmlElement("Shape");
 	doc->LinkEndChild( root );
 
+	definitions_->toXml(root);
+
 	if (structure_ != NULL)
 		root->LinkEndChild(structure_->toXML());
 
@@ -80,6 +85,15 @@ bool Shape<T>::fromXml(TiXmlDocument &doc)
 
 	TiXmlHandle root = docHandle.FirstChildElement("Shape");
 
+	// Definitions, for the Instances in the structure
+	definitions_->clear();
+	if (!definitions_->fromXml(root))
+	{
+		std::cout << "Shape: parse failure Definitions." << std::endl;
+		return false;
+	}
+	const typename Definitions<T>::Scope scope(*definitions_);
+
 	// Load Spheres
 	unsigned spheres = 0;
 	for (TiXmlElement * elem = root.FirstChildElement("Sphere").ToElement();
@@ -98,6 +112,24 @@ bool Shape<T>::fromXml(TiXmlDocument &doc)
 		structure_ = sphere;
 	}
 
+	// Load SphereClouds
+	unsigned sphereClouds = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("SphereCloud").ToElement();
+	     elem; elem = elem->NextSiblingElement("SphereCloud") )
+	{
+		++sphereClouds;
+		std::tr1::shared_ptr<Structure<T> > cloud(new SphereCloud<T>());
+		TiXmlHandle	handle(elem);
+		if (!cloud->fromXML(handle))
+		{
+			std::cout << "Shape: parse failure SphereCloud "
+				<< sphereClouds << "." << std::endl;
+			return false;
+		}
+
+		structure_ = cloud;
+	}
+
 	// Load Tubes
 	unsigned tubes = 0;
 	for (TiXmlElement * elem = root.FirstChildElement("Tube").ToElement();
@@ -170,7 +202,43 @@ bool Shape<T>::fromXml(TiXmlDocument &doc)
 		structure_ = _difference;
 	}
 
-	if (spheres+tubes+unions+intersections+differences != 1)
+	// Load Repeats
+	unsigned repeats = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Repeat").ToElement();
+	     elem; elem = elem->NextSiblingElement("Repeat") )
+	{
+		++repeats;
+		std::tr1::shared_ptr<Structure<T> > repeat(new Repeat<T>());
+		TiXmlHandle	handle(elem);
+		if (!repeat->fromXML(handle))
+		{
+			std::cout << "Shape: parse failure Repeat "
+				<< repeats << "." << std::endl;
+			return false;
+		}
+
+		structure_ = repeat;
+	}
+
+	// Load Instances
+	unsigned instances = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Instance").ToElement();
+	     elem; elem = elem->NextSiblingElement("Instance") )
+	{
+		++instances;
+		std::tr1::shared_ptr<Structure<T> > instance(new Instance<T>());
+		TiXmlHandle	handle(elem);
+		if (!instance->fromXML(handle))
+		{
+			std::cout << "Shape: parse failure Instance "
+				<< instances << "." << std::endl;
+			return false;
+		}
+
+		structure_ = instance;
+	}
+
+	if (spheres+sphereClouds+tubes+unions+intersections+differences+repeats+instances != 1)
 	{
 		std::cout << "Shape: there must be one single main structure." << std::endl;
 		return false;
@@ -239,6 +307,7 @@ template <typename T>
 void Shape<T>::clear()
 {
 	structure_ = std::tr1::shared_ptr<Structure<T> >();
+	definitions_->clear();
 }
 
 template <typename T>
@@ -264,6 +333,7 @@ void Shape<T>::print() const
 	std::cout << "<?xml version=\"1.0\" ?>" << std::endl << std::endl;
 	std::cout << "<Shape>" << std::endl;
 
+	definitions_->print(1);
 	structure_->print(1);
 
 	if (boxSet)
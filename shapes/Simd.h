@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   Copyright (C) 2011 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_SIMD_H
+#define SHAPES_SIMD_H 1
+
+/*
+ * Kernels marked SHAPES_TARGET_CLONES are compiled for several instruction
+ * sets (SSE2, AVX2, AVX-512); the best version is selected at load time
+ * for the CPU at hand, so that one binary runs on all machines.
+ *
+ * Loops marked SHAPES_SIMD are vectorized. When compiled with -ffast-math,
+ * calls to std::pow() in such loops use glibc's vector math library.
+ *
+ * Define SHAPES_NO_TARGET_CLONES to disable runtime dispatch.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && \
+    defined(__linux__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(SHAPES_NO_TARGET_CLONES)
+#define SHAPES_TARGET_CLONES __attribute__((target_clones("default", "avx2", "avx512f")))
+#else
+#define SHAPES_TARGET_CLONES
+#endif
+
+#if defined(_OPENMP) && (_OPENMP >= 201307)
+#define SHAPES_SIMD _Pragma("omp simd")
+#elif defined(__GNUC__) && !defined(__clang__)
+#define SHAPES_SIMD _Pragma("GCC ivdep")
+#else
+#define SHAPES_SIMD
+#endif
+
+#endif
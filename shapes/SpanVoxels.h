@@ -0,0 +1,217 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_SPAN_VOXELS_H
+#define SHAPES_SPAN_VOXELS_H 1
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <tr1/cstdint>
+
+namespace shapes
+{
+
+/*
+ * A binary volume stored per column along the z-axis as the indices where
+ * it changes from outside to inside and back, so that its size follows
+ * the surface rather than the volume. Voxels are indexed [x][y][z] as in
+ * a cvmlcpp::Matrix. The transitions t_0 < t_1 < ... of a column are even
+ * in number: voxels in [t_0, t_1), [t_2, t_3), ... are inside.
+ */
+class SpanVoxels
+{
+	public:
+		typedef std::tr1::uint32_t Index;
+
+		SpanVoxels() : starts_(1, 0)
+		{ dims_[0] = dims_[1] = dims_[2] = 0; }
+
+		// All voxels become 0
+		void resize(const std::size_t dimX, const std::size_t dimY,
+			    const std::size_t dimZ)
+		{
+			dims_[0] = dimX;
+			dims_[1] = dimY;
+			dims_[2] = dimZ;
+			starts_.assign(dimX * dimY + 1, 0);
+			transitions_.clear();
+		}
+
+		void clear() { this->resize(0, 0, 0); }
+
+		bool empty() const { return dims_[0] * dims_[1] * dims_[2] == 0; }
+
+		std::size_t extent(const unsigned dim) const
+		{
+			assert(dim < 3);
+			return dims_[dim];
+		}
+
+		// Transitions of column (x, y)
+		const Index *begin(const std::size_t x, const std::size_t y) const
+		{ return this->data() + starts_[x * dims_[1] + y]; }
+
+		const Index *end(const std::size_t x, const std::size_t y) const
+		{ return this->data() + starts_[x * dims_[1] + y + 1]; }
+
+		// Inside runs of column (x, y)
+		std::size_t spans(const std::size_t x, const std::size_t y) const
+		{ return (this->end(x, y) - this->begin(x, y)) / 2; }
+
+		bool operator()(const std::size_t x, const std::size_t y,
+				const std::size_t z) const
+		{
+			assert(x < dims_[0] && y < dims_[1] && z < dims_[2]);
+			// Odd number of transitions at or before z
+			return (std::upper_bound(this->begin(x, y), this->end(x, y),
+						 Index(z)) - this->begin(x, y)) & 1;
+		}
+
+		// Per column, the offset of its transitions, and one past the
+		// end; and the transitions of all columns after another.
+		const std::vector<std::size_t> &starts() const { return starts_; }
+		std::vector<std::size_t> &starts() { return starts_; }
+
+		const std::vector<Index> &transitions() const { return transitions_; }
+		std::vector<Index> &transitions() { return transitions_; }
+
+	private:
+		std::size_t dims_[3];
+		std::vector<std::size_t> starts_;
+		std::vector<Index> transitions_;
+
+		const Index *data() const
+		{ return transitions_.empty() ? 0 : &transitions_[0]; }
+};
+
+namespace io {
+
+/*
+ * A line "SpanVoxels dimX dimY dimZ transitions", followed by the starts
+ * of the columns as 64-bit numbers and the transitions as 32-bit numbers,
+ * little-endian as on x86.
+ */
+inline bool writeSpanVoxels(const SpanVoxels &voxels, const std::string fileName)
+{
+	std::ofstream out(fileName.c_str(), std::ios::out    |
+					    std::ios::binary |
+					    std::ios::trunc);
+	out << "SpanVoxels " << voxels.extent(0) << " " << voxels.extent(1)
+	    << " " << voxels.extent(2) << " " << voxels.transitions().size() << "\n";
+
+	const std::vector<std::tr1::uint64_t> starts(voxels.starts().begin(),
+						     voxels.starts().end());
+	out.write((const char *)&starts[0],
+		  starts.size() * sizeof(std::tr1::uint64_t));
+	if (!voxels.transitions().empty())
+		out.write((const char *)&voxels.transitions()[0],
+			  voxels.transitions().size() * sizeof(SpanVoxels::Index));
+	out.close();
+
+	return !out.fail();
+}
+
+inline bool readSpanVoxels(const std::string fileName, SpanVoxels &voxels)
+{
+	std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+	std::string magic;
+	std::tr1::uint64_t dims[3], n;
+	in >> magic >> dims[0] >> dims[1] >> dims[2] >> n;
+	if (!in.good() || magic != "SpanVoxels" || in.get() != '\n')
+	{
+		std::cout << "Error reading span voxels from file ["
+			  << fileName << "]." << std::endl;
+		return false;
+	}
+
+	// Bytes after the header
+	const std::streampos here = in.tellg();
+	in.seekg(0, std::ios::end);
+	const std::tr1::uint64_t left = in.tellg() - here;
+	in.seekg(here);
+
+	// Check the header against the size of the file before allocating
+	const std::tr1::uint64_t maxIndex =
+		std::numeric_limits<SpanVoxels::Index>::max();
+	const std::tr1::uint64_t columns = dims[0] * dims[1];
+	if (in.fail() || (dims[0] != 0 && columns / dims[0] != dims[1]) ||
+	    dims[2] > maxIndex || n > maxIndex ||
+	    columns >= left / sizeof(std::tr1::uint64_t) ||
+	    n > (left - (columns + 1u) * sizeof(std::tr1::uint64_t)) /
+		sizeof(SpanVoxels::Index))
+	{
+		std::cout << "Error reading span voxels from file ["
+			  << fileName << "]: invalid size or file too short."
+			  << std::endl;
+		return false;
+	}
+
+	voxels.resize(dims[0], dims[1], dims[2]);
+	std::vector<std::tr1::uint64_t> starts(voxels.starts().size());
+	in.read((char *)&starts[0], starts.size() * sizeof(std::tr1::uint64_t));
+	voxels.transitions().resize(n);
+	if (n > 0)
+		in.read((char *)&voxels.transitions()[0], n * sizeof(SpanVoxels::Index));
+	if (in.fail() || starts.front() != 0 || starts.back() != n ||
+	    std::adjacent_find(starts.begin(), starts.end(),
+			       std::greater<std::tr1::uint64_t>()) != starts.end())
+	{
+		std::cout << "Error reading span voxels from file ["
+			  << fileName << "]: file too short or corrupt." << std::endl;
+		voxels.clear();
+		return false;
+	}
+	std::copy(starts.begin(), starts.end(), voxels.starts().begin());
+
+	// Each column an even number of strictly increasing transitions
+	// within the volume
+	for (std::size_t x = 0; x < dims[0]; ++x)
+	for (std::size_t y = 0; y < dims[1]; ++y)
+	{
+		const SpanVoxels::Index *begin = voxels.begin(x, y);
+		const SpanVoxels::Index *end   = voxels.end(x, y);
+		if ((end - begin) % 2 != 0 ||
+		    std::adjacent_find(begin, end,
+			std::greater_equal<SpanVoxels::Index>()) != end ||
+		    (begin != end && end[-1] > dims[2]))
+		{
+			std::cout << "Error reading span voxels from file ["
+				  << fileName << "]: invalid column (" << x
+				  << ", " << y << ")." << std::endl;
+			voxels.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // end namespace io
+
+} // end namespace shapes
+
+#endif
@@ -42,6 +42,7 @@ class Sphere : public SphericStructure<T>, public Point<T>
 				orientation[i]    = 0.0;
 				orientation[i][i] = 1.0;
 			}
+			this->precompute();
 		}
 
 		Sphere(const FPPoint &_center,
@@ -50,16 +51,21 @@ class Sphere : public SphericStructure<T>, public Point<T>
 			const T _R,
 			const FPVector _rotVector = 1.0f, const T _angle = 0.0, // Radians!!
 			const T _exponent = 2.0, const std::string name__ = "") :
-				Point<T>(_center, _weight, _R, _rotVector, _angle, _exponent),
-				SphericStructure<T>(name__)
-		{ Point<T>::recomputeOrientation(this->rotVector, this->angle, orientation); }
+				SphericStructure<T>(name__),
+				Point<T>(_center, _weight, _R, _rotVector, _angle, _exponent)
+		{
+			Point<T>::recomputeOrientation(this->rotVector, this->angle, orientation);
+			this->precompute();
+		}
 
 		bool set(const FPPoint &_center, const FPVector &_weight,
 		//	 const FPVector _orientation[3],
 			 const T _R, const FPVector _rotVector, const T _angle, const T _exponent)
 		{
 			Point<T>::set(_center, _weight, _R, _rotVector, _angle, _exponent);
-			return Point<T>::recomputeOrientation(this->rotVector, this->angle, this->orientation);
+			const bool ok = Point<T>::recomputeOrientation(this->rotVector, this->angle, this->orientation);
+			this->precompute();
+			return ok;
 		}
 
 		virtual ~Sphere() { }
@@ -72,13 +78,65 @@ class Sphere : public SphericStructure<T>, public Point<T>
 					    FPPoint &_maxCorner) const
 		{ Point<T>::getBoundingBox(_minCorner, _maxCorner); }
 
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
 		virtual void print(unsigned int indent) const;
 
 		bool empty() const { return false; }
 
+		// Rotation and inverse weights as one matrix
+		void getTransform(T m[3][3]) const
+		{
+			for (unsigned i = 0; i < 3; ++i)
+			for (unsigned j = 0; j < 3; ++j)
+				m[i][j] = transform[i][j];
+		}
+
+		virtual void compile(CompiledShape<T> &compiled, const unsigned slot) const;
+
+		// Squared distances of n points, given as structure-of-arrays,
+		// to center c after transformation by m.
+		SHAPES_TARGET_CLONES
+		static void distancesSq(const T * const px, const T * const py,
+					const T * const pz, const std::size_t n,
+					const T c[3], const T m[3][3], T * const distSq);
+
 	private:
 		FPVector orientation[3];
+
+		// Rotation and inverse weights in one matrix: row i is
+		// orientation[i] / weight[i].
+		T transform[3][3];
+
+		// Unrotated, with unit weights
+		bool identity;
+
+		// x^(exponent/2)
+		Power<T> halfPower;
+
+		// Update transform and halfPower after a change of parameters
+		void precompute()
+		{
+			for (unsigned i = 0; i < 3; ++i)
+			for (unsigned j = 0; j < 3; ++j)
+				transform[i][j] = orientation[i][j] / this->weight[i];
+			identity = isIdentity(transform);
+			halfPower.set(this->exponent * T(0.5));
+		}
+
+		static bool isIdentity(const T m[3][3])
+		{
+			for (unsigned i = 0; i < 3; ++i)
+			for (unsigned j = 0; j < 3; ++j)
+				if (m[i][j] != ((i == j) ? T(1) : T(0)))
+					return false;
+			return true;
+		}
+
 		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
+
 };
 
 } // end namespace
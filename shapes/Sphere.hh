@@ -24,6 +24,8 @@
 
 #include <boost/lexical_cast.hpp>
 
+#include <shapes/CompiledShape.h>
+
 namespace shapes
 {
 
@@ -57,6 +59,7 @@ bool Sphere<T>::fromXML(TiXmlHandle &root)
 			<< ": rotation vector problem." << std::endl;
 		return false;
 	}
+	this->precompute();
 
 	return true;
 }
@@ -152,12 +155,108 @@ T Sphere<T>::rawValue(const FPPoint &p) const
 	assert(this->R > 0);
 	assert(this->exponent > 0);
 
-	const T x = cvmlcpp::dotProduct(cp, this->orientation[X]) / (this->weight[X]);
-	const T y = cvmlcpp::dotProduct(cp, this->orientation[Y]) / (this->weight[Y]);
-	const T z = cvmlcpp::dotProduct(cp, this->orientation[Z]) / (this->weight[Z]);
+	if (identity)
+		return this->sphereValue(cp[X]*cp[X] + cp[Y]*cp[Y] + cp[Z]*cp[Z], halfPower, this->R);
+
+	const T x = cp[X]*transform[X][X] + cp[Y]*transform[X][Y] + cp[Z]*transform[X][Z];
+	const T y = cp[X]*transform[Y][X] + cp[Y]*transform[Y][Y] + cp[Z]*transform[Y][Z];
+	const T z = cp[X]*transform[Z][X] + cp[Y]*transform[Z][Y] + cp[Z]*transform[Z][Z];
 	const T distSq = x*x+y*y+z*z;
 
-	return this->sphereValue(distSq, this->exponent, this->R);
+	return this->sphereValue(distSq, halfPower, this->R);
+}
+
+template <typename T>
+void Sphere<T>::distancesSq(const T * const px, const T * const py,
+			    const T * const pz, const std::size_t n,
+			    const T c[3], const T m[3][3], T * const distSq)
+{
+	const T cx = c[X], cy = c[Y], cz = c[Z];
+
+	if (isIdentity(m))
+	{
+		SHAPES_SIMD
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			const T dx = px[i] - cx;
+			const T dy = py[i] - cy;
+			const T dz = pz[i] - cz;
+			distSq[i] = dx*dx+dy*dy+dz*dz;
+		}
+		return;
+	}
+
+	SHAPES_SIMD
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		const T dx = px[i] - cx;
+		const T dy = py[i] - cy;
+		const T dz = pz[i] - cz;
+
+		const T x = dx*m[X][X] + dy*m[X][Y] + dz*m[X][Z];
+		const T y = dx*m[Y][X] + dy*m[Y][Y] + dz*m[Y][Z];
+		const T z = dx*m[Z][X] + dy*m[Z][Y] + dz*m[Z][Z];
+		distSq[i] = x*x+y*y+z*z;
+	}
+}
+
+template <typename T>
+void Sphere<T>::rawValues(const FPPoint * const pts, T * const out,
+			  const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+
+	// Structure-of-arrays copy of the block
+	T px[Structure<T>::blockSize];
+	T py[Structure<T>::blockSize];
+	T pz[Structure<T>::blockSize];
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		px[i] = pts[i][X];
+		py[i] = pts[i][Y];
+		pz[i] = pts[i][Z];
+	}
+
+	const T c [] = { this->center[X], this->center[Y], this->center[Z] };
+	T distSq[Structure<T>::blockSize];
+	distancesSq(px, py, pz, n, c, transform, distSq);
+	this->sphereValues(distSq, out, n, this->exponent, this->R);
+}
+
+template <typename T>
+bool Sphere<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	const T eps = this->supportLevel();
+	if (!(eps > T(0)))
+		return false;
+
+	// The value (d / R)^-e is at least eps within a weighted distance
+	// d of R eps^(-1/e), an ellipsoid with semi-axes along the
+	// orientation scaled by the weights.
+	const T r = this->R * std::pow(eps, T(-1) / this->exponent) *
+		    (T(1) + Structure<T>::supportMargin());
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		T extentSq = 0;
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			const T a = orientation[i][d] * this->weight[i];
+			extentSq += a * a;
+		}
+		const T extent = r * std::sqrt(extentSq);
+		lower[d] = this->center[d] - extent;
+		upper[d] = this->center[d] + extent;
+	}
+
+	return true;
+}
+
+template <typename T>
+void Sphere<T>::compile(CompiledShape<T> &compiled, const unsigned slot) const
+{
+	const T c [] = { this->center[X], this->center[Y], this->center[Z] };
+	compiled.emitSphere(c, transform, this->R, this->exponent, slot);
+	this->compileDamping(compiled, slot);
 }
 
 template <typename T>
@@ -0,0 +1,156 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_SPHERE_CLOUD_H
+#define SHAPES_SPHERE_CLOUD_H 1
+
+#include <vector>
+
+#include <shapes/Structure.h>
+#include <shapes/Sphere.h>
+#include <shapes/Power.h>
+
+namespace shapes
+{
+
+/*
+ * A Union of Spheres, such as a packing of particles, with the parameters
+ * of the spheres stored in arrays rather than as separate structures. The
+ * value is the same as that of the equivalent Union. Damped spheres are
+ * found through a grid of cells by their centers; the names of the
+ * spheres are not kept.
+ */
+template <typename T>
+class SphereCloud : public Structure<T>
+{
+	public:
+		typedef typename Structure<T>::FPPoint  FPPoint;
+		typedef typename Structure<T>::FPVector FPVector;
+
+		SphereCloud(const std::string name__ = "", T _exponent = 2.) :
+			Structure<T>(name__), exponent(_exponent)
+		{ this->setPowers(); }
+
+		SphereCloud(T _exponent, const std::string name__ = "") :
+			Structure<T>(name__), exponent(_exponent)
+		{ this->setPowers(); }
+
+		virtual ~SphereCloud() { }
+
+		virtual bool fromXML(TiXmlHandle &root);
+
+		virtual TiXmlElement * const toXML() const;
+
+		virtual void getBoundingBox(FPPoint &_minCorner,
+					    FPPoint &_maxCorner) const;
+
+		// If all spheres are damped, the box around their supports
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
+		virtual void print(unsigned int indent) const;
+
+		virtual T cost() const { return T(1) + T(this->size()); }
+
+		// Call index() after adding spheres.
+		void add(const Sphere<T> &sphere);
+
+		// Build the grid of damped spheres. Done by fromXML().
+		void index();
+
+		void clear();
+
+		// The exponent of the union of the spheres
+		T getExponent() const { return exponent; }
+
+		std::size_t size() const { return radii.size(); }
+
+		bool empty() const { return radii.empty(); }
+
+	private:
+		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
+
+		T exponent;
+
+		// x^exponent and x^(1/exponent)
+		Power<T> power, root;
+
+		void setPowers()
+		{
+			power.set(exponent);
+			root.set(T(1) / exponent);
+		}
+
+		// Per sphere: rotation and inverse weights as one matrix
+		struct Transform { T m[3][3]; };
+
+		// Per sphere; centers and extents have three values each. The
+		// support of a damped sphere is its center plus or minus its
+		// extents.
+		std::vector<T> centers;
+		std::vector<Transform> transforms;
+		std::vector<T> radii, exponents, dampLows, dampHighs;
+		std::vector<T> extents;
+		std::vector<char> bounded;
+
+		// Weights and orientation of the spheres that have them, by
+		// increasing index
+		struct Orientation
+		{
+			std::size_t sphere;
+			FPVector weight, rotVector;
+			T angle;
+		};
+		std::vector<Orientation> oriented;
+
+		// Damped spheres in cells by their centers: those in cell c are
+		// cellItems[cellStart[c]] up to cellItems[cellStart[c+1]]. The
+		// supports reach at most 'reach' beyond the cell of the center.
+		FPPoint gridOrigin;
+		T cellSize;
+		std::size_t gridSize[3];
+		std::vector<std::size_t> cellStart, cellItems;
+		FPVector reach;
+
+		// Undamped spheres, always evaluated
+		std::vector<std::size_t> unbounded;
+
+		// Sorted indices of spheres that may not vanish in the box
+		void activeSpheres(const FPPoint &lower, const FPPoint &upper,
+				   std::vector<std::size_t> &active) const;
+
+		// Cell of a coordinate along dimension d, clamped to the grid
+		std::size_t cell(const T x, const unsigned d) const
+		{
+			const T c = std::floor((x - gridOrigin[d]) / cellSize);
+			if (!(c > T(0)))
+				return 0u;
+			return std::min(static_cast<std::size_t>(c), gridSize[d] - 1u);
+		}
+
+		Sphere<T> sphere(const std::size_t i, const Orientation * const o) const;
+};
+
+} // end namespace
+
+#include <shapes/SphereCloud.hh>
+
+#endif
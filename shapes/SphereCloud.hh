@@ -0,0 +1,589 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include <boost/lexical_cast.hpp>
+
+namespace shapes
+{
+
+template <typename T>
+void SphereCloud<T>::clear()
+{
+	centers.clear();
+	transforms.clear();
+	radii.clear();
+	exponents.clear();
+	dampLows.clear();
+	dampHighs.clear();
+	extents.clear();
+	bounded.clear();
+	oriented.clear();
+	cellStart.clear();
+	cellItems.clear();
+	unbounded.clear();
+	this->setName("");
+}
+
+template <typename T>
+void SphereCloud<T>::add(const Sphere<T> &sphere)
+{
+	const FPVector c = sphere.getCenter();
+	FPPoint lower, upper;
+	const bool b = sphere.getSupport(lower, upper);
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		centers.push_back(c[d]);
+		extents.push_back(b ? std::max(upper[d] - c[d], c[d] - lower[d]) : T(0));
+	}
+
+	Transform t;
+	sphere.getTransform(t.m);
+	transforms.push_back(t);
+
+	radii.push_back(sphere.getRadius());
+	exponents.push_back(sphere.getExponent());
+	dampLows.push_back(sphere.getDampLow());
+	dampHighs.push_back(sphere.getDampHigh());
+	bounded.push_back(b);
+
+	const FPVector w = sphere.getWeight();
+	if (w[X] != 1 || w[Y] != 1 || w[Z] != 1 || sphere.getAngle() != 0)
+	{
+		Orientation o;
+		o.sphere = radii.size() - 1u;
+		o.weight = w;
+		o.rotVector = sphere.getRotationVector();
+		o.angle = sphere.getAngle();
+		oriented.push_back(o);
+	}
+}
+
+template <typename T>
+void SphereCloud<T>::index()
+{
+	unbounded.clear();
+	cellStart.clear();
+	cellItems.clear();
+
+	std::vector<std::size_t> items;
+	for (std::size_t i = 0; i < this->size(); ++i)
+		if (bounded[i])
+			items.push_back(i);
+		else
+			unbounded.push_back(i);
+	if (items.empty())
+		return;
+
+	FPPoint lower( std::numeric_limits<T>::max());
+	FPPoint upper(-std::numeric_limits<T>::max());
+	reach = 0;
+	for (std::size_t k = 0; k < items.size(); ++k)
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			const std::size_t i = 3u * items[k] + d;
+			lower[d] = std::min(lower[d], centers[i]);
+			upper[d] = std::max(upper[d], centers[i]);
+			reach[d] = std::max(reach[d], extents[i]);
+		}
+
+	// Cells about as wide as the largest support, but not many more
+	// cells than spheres
+	cellSize = T(2) * std::max(reach[X], std::max(reach[Y], reach[Z]));
+	for (;;)
+	{
+		T cells = 1;
+		for (unsigned d = 0; d < 3; ++d)
+			cells *= std::floor((upper[d] - lower[d]) / cellSize) + T(1);
+		if (cells <= T(4u * items.size()))
+			break;
+		cellSize *= T(2);
+	}
+	gridOrigin = lower;
+	for (unsigned d = 0; d < 3; ++d)
+		gridSize[d] = static_cast<std::size_t>(
+				std::floor((upper[d] - lower[d]) / cellSize)) + 1u;
+
+	// Count, then place the spheres, in order of their index
+	std::vector<std::size_t> cellOf(items.size());
+	cellStart.resize(gridSize[X] * gridSize[Y] * gridSize[Z] + 1u, 0u);
+	for (std::size_t k = 0; k < items.size(); ++k)
+	{
+		const T * const c = &centers[3u * items[k]];
+		cellOf[k] = (this->cell(c[Z], Z) * gridSize[Y] + this->cell(c[Y], Y)) *
+				gridSize[X] + this->cell(c[X], X);
+		++cellStart[cellOf[k] + 1u];
+	}
+	for (std::size_t c = 1; c < cellStart.size(); ++c)
+		cellStart[c] += cellStart[c - 1u];
+
+	std::vector<std::size_t> next(cellStart.begin(), cellStart.end() - 1);
+	cellItems.resize(items.size());
+	for (std::size_t k = 0; k < items.size(); ++k)
+		cellItems[next[cellOf[k]]++] = items[k];
+}
+
+template <typename T>
+void SphereCloud<T>::activeSpheres(const FPPoint &lower, const FPPoint &upper,
+				   std::vector<std::size_t> &active) const
+{
+	active = unbounded;
+	if (cellStart.empty())
+		return;
+
+	std::size_t from[3], to[3];
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		from[d] = this->cell(lower[d] - reach[d], d);
+		to[d]   = this->cell(upper[d] + reach[d], d);
+	}
+
+	for (std::size_t z = from[Z]; z <= to[Z]; ++z)
+	for (std::size_t y = from[Y]; y <= to[Y]; ++y)
+	for (std::size_t x = from[X]; x <= to[X]; ++x)
+	{
+		const std::size_t c = (z * gridSize[Y] + y) * gridSize[X] + x;
+		for (std::size_t k = cellStart[c]; k < cellStart[c + 1u]; ++k)
+		{
+			const std::size_t s = cellItems[k];
+			bool overlap = true;
+			for (unsigned d = 0; d < 3 && overlap; ++d)
+				overlap = centers[3u*s + d] - extents[3u*s + d] <= upper[d] &&
+					  centers[3u*s + d] + extents[3u*s + d] >= lower[d];
+			if (overlap)
+				active.push_back(s);
+		}
+	}
+
+	// Sums in the same order as a Union
+	std::sort(active.begin(), active.end());
+}
+
+template <typename T>
+T SphereCloud<T>::rawValue(const FPPoint &p) const
+{
+	T val;
+	this->rawValues(&p, &val, 1u);
+	return val;
+}
+
+template <typename T>
+void SphereCloud<T>::rawValues(const FPPoint * const pts, T * const out,
+			       const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+
+	std::fill(out, out + n, T(0.0));
+	if (n == 0u)
+		return;
+
+	// Structure-of-arrays copy of the block, and the box around it
+	T px[Structure<T>::blockSize];
+	T py[Structure<T>::blockSize];
+	T pz[Structure<T>::blockSize];
+	FPPoint lower = pts[0];
+	FPPoint upper = pts[0];
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		px[i] = pts[i][X];
+		py[i] = pts[i][Y];
+		pz[i] = pts[i][Z];
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], pts[i][d]);
+			upper[d] = std::max(upper[d], pts[i][d]);
+		}
+	}
+
+	std::vector<std::size_t> active;
+	this->activeSpheres(lower, upper, active);
+
+	// Of damped spheres, only the points in their support
+	T sx[Structure<T>::blockSize];
+	T sy[Structure<T>::blockSize];
+	T sz[Structure<T>::blockSize];
+	std::size_t index[Structure<T>::blockSize];
+	T distSq[Structure<T>::blockSize];
+	T values[Structure<T>::blockSize];
+	for (std::vector<std::size_t>::const_iterator i = active.begin();
+	     i != active.end(); ++i)
+	{
+		const std::size_t s = *i;
+		const T * const c = &centers[3u * s];
+
+		std::size_t m = n;
+		const T *qx = px, *qy = py, *qz = pz;
+		if (bounded[s])
+		{
+			const T * const e = &extents[3u * s];
+			m = 0;
+			for (std::size_t j = 0; j < n; ++j)
+				if (std::abs(px[j] - c[X]) <= e[X] &&
+				    std::abs(py[j] - c[Y]) <= e[Y] &&
+				    std::abs(pz[j] - c[Z]) <= e[Z])
+				{
+					sx[m] = px[j];
+					sy[m] = py[j];
+					sz[m] = pz[j];
+					index[m++] = j;
+				}
+			qx = sx; qy = sy; qz = sz;
+		}
+		if (m == 0u)
+			continue;
+
+		Sphere<T>::distancesSq(qx, qy, qz, m, c, transforms[s].m, distSq);
+		SphericStructure<T>::sphereValues(distSq, values, m, exponents[s], radii[s]);
+
+		if (dampLows[s] != T(1) || dampHighs[s] != T(1))
+			for (std::size_t j = 0; j < m; ++j)
+				values[j] = Structure<T>::dampValue(values[j],
+						dampLows[s], dampHighs[s]);
+
+		if (bounded[s])
+			for (std::size_t j = 0; j < m; ++j)
+				out[index[j]] += power(values[j]);
+		else
+			for (std::size_t j = 0; j < n; ++j)
+				out[j] += power(values[j]);
+	}
+
+	for (std::size_t j = 0; j < n; ++j)
+		out[j] = root(out[j]);
+}
+
+template <typename T>
+void SphereCloud<T>::getBoundingBox(FPPoint &_minCorner, FPPoint &_maxCorner) const
+{
+	_minCorner =  std::numeric_limits<T>::max();
+	_maxCorner = -std::numeric_limits<T>::max();
+
+	// As Point::getBoundingBox()
+	typename std::vector<Orientation>::const_iterator o = oriented.begin();
+	for (std::size_t i = 0; i < this->size(); ++i)
+	{
+		FPVector w = 1;
+		if (o != oriented.end() && o->sphere == i)
+			w = (o++)->weight;
+
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			_minCorner[d] = std::min(_minCorner[d], centers[3u*i + d] - radii[i] / w[d]);
+			_maxCorner[d] = std::max(_maxCorner[d], centers[3u*i + d] + radii[i] / w[d]);
+		}
+	}
+}
+
+template <typename T>
+bool SphereCloud<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	if (this->empty() || !unbounded.empty())
+		return false;
+
+	lower =  std::numeric_limits<T>::max();
+	upper = -std::numeric_limits<T>::max();
+	for (std::size_t i = 0; i < this->size(); ++i)
+	{
+		if (!bounded[i])
+			return false;
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], centers[3u*i + d] - extents[3u*i + d]);
+			upper[d] = std::max(upper[d], centers[3u*i + d] + extents[3u*i + d]);
+		}
+	}
+
+	return true;
+}
+
+template <typename T>
+Sphere<T> SphereCloud<T>::sphere(const std::size_t i, const Orientation * const o) const
+{
+	FPPoint c;
+	for (unsigned d = 0; d < 3; ++d)
+		c[d] = centers[3u*i + d];
+
+	FPVector rotVector = 0;
+	rotVector[X] = 1;
+	Sphere<T> s(c, o ? o->weight : FPVector(1), radii[i],
+		    o ? o->rotVector : rotVector, o ? o->angle : T(0), exponents[i]);
+	s.setDamping(dampLows[i], dampHighs[i]);
+
+	return s;
+}
+
+template <typename T>
+bool SphereCloud<T>::fromXML(TiXmlHandle &root)
+{
+	using boost::lexical_cast;
+
+	this->clear();
+
+	TiXmlElement * elem = root.FirstChildElement("Name").ToElement();
+	if (elem)
+		this->setName(elem->GetText());
+
+	if ( (elem = root.FirstChildElement("Exponent").ToElement()) )
+		this->exponent = lexical_cast<T>(elem->GetText());
+	if (!(exponent > T(0)))
+	{
+		std::cout << "SphereCloud"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": Exponent parse failure, Exponent not greater than zero." << std::endl;
+		return false;
+	}
+	this->setPowers();
+
+	if ( (elem = root.FirstChildElement("DampLow").ToElement()) )
+		this->dampLow = lexical_cast<T>(elem->GetText());
+
+	if ( (elem = root.FirstChildElement("DampHigh").ToElement()) )
+		this->dampHigh = lexical_cast<T>(elem->GetText());
+
+	// Common parameters of the spheres in the compact list
+	T sphereExponent = 2, sphereDampLow = 1, sphereDampHigh = 1;
+	if ( (elem = root.FirstChildElement("SphereExponent").ToElement()) )
+		sphereExponent = lexical_cast<T>(elem->GetText());
+	if (!(sphereExponent > T(0)))
+	{
+		std::cout << "SphereCloud"
+			<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+			<< ": SphereExponent not greater than zero." << std::endl;
+		return false;
+	}
+
+	if ( (elem = root.FirstChildElement("SphereDampLow").ToElement()) )
+		sphereDampLow = lexical_cast<T>(elem->GetText());
+
+	if ( (elem = root.FirstChildElement("SphereDampHigh").ToElement()) )
+		sphereDampHigh = lexical_cast<T>(elem->GetText());
+
+	// Compact lists of the center and radius of each sphere, and other
+	// spheres in full, in the order given
+	FPVector rotVector = 0;
+	rotVector[X] = 1;
+	unsigned spheres = 0;
+	for (TiXmlElement * elem = root.FirstChildElement().ToElement();
+	     elem; elem = elem->NextSiblingElement() )
+	{
+		const std::string tag = elem->Value();
+		if (tag == "Spheres")
+		{
+			std::stringstream s(elem->GetText() ? elem->GetText() : "");
+			std::vector<T> numbers;
+			T x;
+			while (s >> x)
+				numbers.push_back(x);
+			if (!s.eof() || numbers.size() % 4u != 0u)
+			{
+				std::cout << "SphereCloud"
+					<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+					<< ": Spheres parse failure, expected groups of "
+					<< "X Y Z Radius." << std::endl;
+				return false;
+			}
+
+			for (std::size_t i = 0; i < numbers.size(); i += 4u)
+			{
+				if (!(numbers[i + 3u] > T(0)))
+				{
+					std::cout << "SphereCloud"
+						<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+						<< ": Radius of sphere " << this->size() + 1u
+						<< " not greater than zero." << std::endl;
+					return false;
+				}
+
+				const FPPoint c(numbers[i], numbers[i + 1u], numbers[i + 2u]);
+				Sphere<T> sphere(c, FPVector(1), numbers[i + 3u],
+						 rotVector, T(0), sphereExponent);
+				sphere.setDamping(sphereDampLow, sphereDampHigh);
+				this->add(sphere);
+			}
+		}
+		else if (tag == "Sphere")
+		{
+			++spheres;
+			Sphere<T> sphere;
+			TiXmlHandle	handle(elem);
+			if (!sphere.fromXML(handle))
+			{
+				std::cout << "SphereCloud"
+					<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+					<< ": parse failure Sphere "
+					<< spheres << "." << std::endl;
+				return false;
+			}
+
+			this->add(sphere);
+		}
+	}
+	this->index();
+
+	return true;
+}
+
+template <typename T>
+TiXmlElement * const SphereCloud<T>::toXML() const
+{
+	using boost::lexical_cast;
+
+	TiXmlElement * const root = new TiXmlElement("SphereCloud");
+
+	std::string buf;
+
+	if (!this->name().empty())
+	{
+		TiXmlElement * const nameElem = new TiXmlElement("Name");
+		nameElem->LinkEndChild( new TiXmlText(this->name().c_str()) );
+		root->LinkEndChild(nameElem);
+	}
+
+	buf = lexical_cast<std::string>(this->exponent);
+	TiXmlElement * const exponentElem = new TiXmlElement("Exponent");
+	exponentElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+	root->LinkEndChild(exponentElem);
+
+	if (this->dampLow != 1)
+	{
+		buf = lexical_cast<std::string>(this->dampLow);
+		TiXmlElement * const dampLowElem = new TiXmlElement("DampLow");
+		dampLowElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(dampLowElem);
+	}
+
+	if (this->dampHigh != 1)
+	{
+		buf = lexical_cast<std::string>(this->dampHigh);
+		TiXmlElement * const dampHighElem = new TiXmlElement("DampHigh");
+		dampHighElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(dampHighElem);
+	}
+
+	// Spheres without weights or orientation, and with the parameters of
+	// the first of them, go in the compact list.
+	std::vector<char> compact(this->size(), true);
+	for (typename std::vector<Orientation>::const_iterator o = oriented.begin();
+	     o != oriented.end(); ++o)
+		compact[o->sphere] = false;
+	const std::size_t first = std::find(compact.begin(), compact.end(), char(true)) - compact.begin();
+
+	if (first < this->size())
+	{
+		buf = lexical_cast<std::string>(exponents[first]);
+		TiXmlElement * const sphereExponentElem = new TiXmlElement("SphereExponent");
+		sphereExponentElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(sphereExponentElem);
+
+		if (dampLows[first] != 1)
+		{
+			buf = lexical_cast<std::string>(dampLows[first]);
+			TiXmlElement * const dampLowElem = new TiXmlElement("SphereDampLow");
+			dampLowElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+			root->LinkEndChild(dampLowElem);
+		}
+
+		if (dampHighs[first] != 1)
+		{
+			buf = lexical_cast<std::string>(dampHighs[first]);
+			TiXmlElement * const dampHighElem = new TiXmlElement("SphereDampHigh");
+			dampHighElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+			root->LinkEndChild(dampHighElem);
+		}
+	}
+
+	// In order, runs of compact spheres as one list each, and the others
+	// in full
+	std::stringstream s;
+	s.precision(std::numeric_limits<T>::digits10 + 2);
+	typename std::vector<Orientation>::const_iterator o = oriented.begin();
+	for (std::size_t i = 0; i < this->size(); ++i)
+	{
+		const Orientation * const orientation =
+			(o != oriented.end() && o->sphere == i) ? &*(o++) : 0;
+		if (compact[i] && exponents[i] == exponents[first] &&
+		    dampLows[i] == dampLows[first] && dampHighs[i] == dampHighs[first])
+		{
+			s << (s.tellp() > 0 ? "  " : "") << centers[3u*i] << " "
+			  << centers[3u*i + 1u] << " " << centers[3u*i + 2u] << " " << radii[i];
+			if (i + 1u < this->size())
+				continue;
+		}
+		else
+			compact[i] = false;
+
+		if (s.tellp() > 0)
+		{
+			TiXmlElement * const spheresElem = new TiXmlElement("Spheres");
+			spheresElem->LinkEndChild( new TiXmlText(s.str().c_str()) );
+			root->LinkEndChild(spheresElem);
+			s.str("");
+		}
+		if (!compact[i])
+			root->LinkEndChild( this->sphere(i, orientation).toXML() );
+	}
+
+	return root;
+}
+
+template <typename T>
+void SphereCloud<T>::print(unsigned indent) const
+{
+	using boost::lexical_cast;
+
+	Structure<T>::printIndented("<SphereCloud>", indent);
+	std::string buf;
+
+	if (this->dampLow != 1)
+	{
+		buf = "<DampLow>"+lexical_cast<std::string>(this->dampLow)+"</DampLow>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (this->dampHigh != 1)
+	{
+		buf = "<DampHigh>"+lexical_cast<std::string>(this->dampHigh)+"</DampHigh>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	if (!this->name().empty())
+	{
+		buf = "<Name>"+this->name()+"</Name>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
+	typename std::vector<Orientation>::const_iterator o = oriented.begin();
+	for (std::size_t i = 0; i < this->size(); ++i)
+	{
+		const Orientation * const orientation =
+			(o != oriented.end() && o->sphere == i) ? &*(o++) : 0;
+		this->sphere(i, orientation).print(indent + 1);
+	}
+
+	Structure<T>::printIndented("</SphereCloud>\n", indent);
+}
+
+} // end namespace
@@ -0,0 +1,281 @@
+/***************************************************************************
+ *   Copyright (C) 2006 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SHAPES_SPHERE_CLUSTERS_H
+#define SHAPES_SPHERE_CLUSTERS_H 1
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <cvmlcpp/base/Enums>
+
+#include <shapes/BoxTree.h>
+#include <shapes/EuclidTypes.h>
+#include <shapes/Power.h>
+#include <shapes/Structure.h>
+
+namespace shapes
+{
+
+template <typename T>
+class Sphere;
+
+/*
+ * Barnes-Hut style approximation of the sum of sphere values raised to a
+ * power, as in a Union, for points far from a cluster of spheres.
+ *
+ * The spheres are grouped in a tree by their centers. At a distance r from
+ * a sphere, its weighted distance is between r / (largest weight) and
+ * r / (smallest weight); its term (weighted distance / R)^-k, with k the
+ * exponent of the sphere times that of the union, is thus bounded by sums
+ * over the cluster divided by the nearest and farthest distance to the
+ * centers raised to the power k. A cluster whose spheres share k is
+ * replaced by the mean of these bounds when half their difference is
+ * small enough; other spheres are left to be evaluated exactly.
+ */
+template <typename T>
+class SphereClusters
+{
+	public:
+		typedef typename EuclidTypes<T>::FPPoint FPPoint;
+
+		bool empty() const { return tree.empty(); }
+
+		void clear()
+		{
+			tree.clear();
+			spheres.clear();
+			clusters.clear();
+		}
+
+		// Index spheres that are raised to the power 'exponent'
+		void build(const std::vector<const Sphere<T> *> &_spheres, const T exponent);
+
+		std::size_t size() const { return spheres.size(); }
+
+		/*
+		 * Add the approximate terms of distant clusters to 'sums',
+		 * with an error of at most 'tolerance' per point; append the
+		 * indices, into the spheres given to build(), of the others
+		 * to 'exact'. Clusters are chosen for all points at once.
+		 */
+		void approximate(const FPPoint * const pts, const std::size_t n,
+				 const T tolerance, T * const sums,
+				 std::vector<std::size_t> &exact) const;
+
+	private:
+		BoxTree<T> tree;
+
+		std::vector<const Sphere<T> *> spheres;
+
+		// Per node: the common power k of its spheres, or zero if they
+		// differ; and the sums of (largest weight * R)^k and
+		// (smallest weight * R)^k over its spheres.
+		struct Cluster
+		{
+			T k, upperSum, lowerSum;
+			std::size_t count;
+			// x^(-k/2), for squared distances
+			Power<T> power;
+		};
+		std::vector<Cluster> clusters;
+
+		// Push a node on the heap of clusters by their error for the
+		// points in [lower, upper]; the maximum if it cannot be used
+		// or exceeds the tolerance.
+		void push(const FPPoint &lower, const FPPoint &upper,
+			  const std::size_t node, const T tolerance,
+			  std::vector<std::pair<T, std::size_t> > &heap,
+			  std::size_t &unusable, T &error) const;
+
+		// Squared distances from the box [lower0, upper0] to the nearest
+		// and farthest point of the box [lower1, upper1]
+		static void distancesSq(const FPPoint &lower0, const FPPoint &upper0,
+					const FPPoint &lower1, const FPPoint &upper1,
+					T &nearSq, T &farSq)
+		{
+			nearSq = farSq = 0;
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				const T gap = std::max(T(0), std::max(lower1[d] - upper0[d],
+								      lower0[d] - upper1[d]));
+				const T span = std::max(upper1[d] - lower0[d], upper0[d] - lower1[d]);
+				nearSq += gap * gap;
+				farSq  += span * span;
+			}
+		}
+};
+
+template <typename T>
+void SphereClusters<T>::build(const std::vector<const Sphere<T> *> &_spheres,
+			      const T exponent)
+{
+	this->clear();
+	spheres = _spheres;
+	if (spheres.empty())
+		return;
+
+	std::vector<FPPoint> centers(spheres.size());
+	std::vector<std::size_t> items(spheres.size());
+	for (std::size_t i = 0; i < spheres.size(); ++i)
+	{
+		centers[i] = spheres[i]->getCenter();
+		items[i] = i;
+	}
+	tree.build(centers, centers, items);
+
+	// Children come after their parents, so bottom-up in reverse
+	clusters.resize(tree.nodeCount());
+	for (std::size_t node = clusters.size(); node-- > 0u; )
+	{
+		Cluster &c = clusters[node];
+		if (tree.isLeaf(node))
+		{
+			c.upperSum = c.lowerSum = 0;
+			c.count = 0u;
+			for (std::size_t i = tree.leafBegin(node); i < tree.leafEnd(node); ++i)
+			{
+				const Sphere<T> &sphere = *spheres[tree.item(i)];
+				const T k = sphere.getExponent() * exponent;
+				c.k = (c.count == 0u || c.k == k) ? k : T(0);
+
+				const typename EuclidTypes<T>::FPVector w = sphere.getWeight();
+				const T wMax = std::max(w[X], std::max(w[Y], w[Z]));
+				const T wMin = std::min(w[X], std::min(w[Y], w[Z]));
+				c.upperSum += std::pow(wMax * sphere.getRadius(), k);
+				c.lowerSum += std::pow(wMin * sphere.getRadius(), k);
+				++c.count;
+			}
+		}
+		else
+		{
+			const Cluster &a = clusters[tree.firstChild(node)];
+			const Cluster &b = clusters[tree.firstChild(node) + 1u];
+			c.k = (a.k == b.k) ? a.k : T(0);
+			c.upperSum = a.upperSum + b.upperSum;
+			c.lowerSum = a.lowerSum + b.lowerSum;
+			c.count = a.count + b.count;
+		}
+		c.power.set(T(-0.5) * c.k);
+	}
+}
+
+template <typename T>
+void SphereClusters<T>::approximate(const FPPoint * const pts, const std::size_t n,
+				    const T tolerance, T * const sums,
+				    std::vector<std::size_t> &exact) const
+{
+	if (tree.empty() || n == 0u)
+		return;
+
+	// Box around the points
+	FPPoint lower = pts[0];
+	FPPoint upper = pts[0];
+	for (std::size_t i = 1; i < n; ++i)
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], pts[i][d]);
+			upper[d] = std::max(upper[d], pts[i][d]);
+		}
+
+	// Starting from the root, split the cluster with the largest
+	// error until they add up to at most the tolerance; clusters
+	// close to the points, or with mixed exponents, cannot be used.
+	std::vector<std::pair<T, std::size_t> > heap;
+	std::size_t unusable = 0;
+	T error = 0;
+	this->push(lower, upper, 0u, tolerance, heap, unusable, error);
+	while ( (unusable > 0u || error > tolerance) && !heap.empty() )
+	{
+		std::pop_heap(heap.begin(), heap.end());
+		const T e = heap.back().first;
+		const std::size_t node = heap.back().second;
+		heap.pop_back();
+		if (e == std::numeric_limits<T>::max())
+			--unusable;
+		else
+			error -= e;
+
+		if (tree.isLeaf(node))
+			for (std::size_t i = tree.leafBegin(node); i < tree.leafEnd(node); ++i)
+				exact.push_back(tree.item(i));
+		else
+		{
+			this->push(lower, upper, tree.firstChild(node),      tolerance, heap, unusable, error);
+			this->push(lower, upper, tree.firstChild(node) + 1u, tolerance, heap, unusable, error);
+		}
+	}
+
+	// The remaining clusters, tighter for each point by itself
+	for (typename std::vector<std::pair<T, std::size_t> >::const_iterator
+	     h = heap.begin(); h != heap.end(); ++h)
+	{
+		const std::size_t node = h->second;
+		const Cluster &c = clusters[node];
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			T nearSq, farSq;
+			distancesSq(pts[i], pts[i], tree.nodeLower(node), tree.nodeUpper(node),
+				    nearSq, farSq);
+			sums[i] += T(0.5) * (c.upperSum * c.power(nearSq) +
+					     c.lowerSum * c.power(farSq));
+		}
+	}
+}
+
+template <typename T>
+void SphereClusters<T>::push(const FPPoint &lower, const FPPoint &upper,
+			     const std::size_t node, const T tolerance,
+			     std::vector<std::pair<T, std::size_t> > &heap,
+			     std::size_t &unusable, T &error) const
+{
+	const Cluster &c = clusters[node];
+
+	T e = std::numeric_limits<T>::max();
+	if (c.k > T(0))
+	{
+		T nearSq, farSq;
+		distancesSq(lower, upper, tree.nodeLower(node), tree.nodeUpper(node),
+			    nearSq, farSq);
+		if (nearSq > T(0))
+			e = T(0.5) * (c.upperSum * c.power(nearSq) - c.lowerSum * c.power(farSq));
+	}
+
+	// Clusters with an error beyond the tolerance must be split anyway;
+	// they are not summed, which would lose the small errors to rounding.
+	if (e <= tolerance)
+		error += e;
+	else
+	{
+		e = std::numeric_limits<T>::max();
+		++unusable;
+	}
+
+	heap.push_back(std::make_pair(e, node));
+	std::push_heap(heap.begin(), heap.end());
+}
+
+} // end namespace
+
+#endif
@@ -21,7 +21,12 @@
 #ifndef SHAPES_SPHERIC_STRUCTURE_H
 #define SHAPES_SPHERIC_STRUCTURE_H 1
 
+#include <cmath>
+#include <limits>
+
 #include <shapes/Structure.h>
+#include <shapes/Simd.h>
+#include <shapes/Power.h>
 
 namespace shapes
 {
@@ -40,24 +45,76 @@ class SphericStructure : public Structure<T>
 
 		virtual ~SphericStructure() { }
 
+		// sphereValue() for n distances with common exponent and radius
+		SHAPES_TARGET_CLONES
+		static void sphereValues(const T * const distSq, T * const out,
+					 const std::size_t n, const T e, const T r)
+		{
+			const T rSq = r*r;
+			const Power<T> halfPower(e * T(0.5));
+			const Capping &capping = SphericStructure<T>::capping();
+
+			// In passes, so that each loop vectorizes
+			SHAPES_SIMD
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = distSq[i]/rSq;
+			halfPower(out, out, n);
+			SHAPES_SIMD
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = capped( out[i], capping );
+		}
+
+		// Sphere value from val_inv = (distSq / r^2)^(e/2), capped
+		// near the center to avoid infinity.
+		static T capped(const T val_inv)
+		{ return capped(val_inv, capping()); }
+
 	protected:
 		T sphereValue(const T distSq, const T e, const T r) const
 		{
-			T val_inv = std::pow( distSq/(r*r), e * T(0.5));
+			return this->sphereValue(distSq, Power<T>(e * T(0.5)), r);
+		}
 
-			// Capping value, to avoid infty
-			const T gamma = std::numeric_limits<T>::max() / 2.;
+		// halfPower: x^(e/2)
+		T sphereValue(const T distSq, const Power<T> &halfPower, const T r) const
+		{
+			return capped( halfPower(distSq/(r*r)) );
+		}
 
-			// delta chosen to be a number small yet still significant with
-			// respect to gamma.
-			const T delta = gamma / std::pow(T(2), T(std::numeric_limits<T>::digits));
-			assert(gamma + delta > gamma);
-			assert(gamma - delta < gamma);
+	private:
+		// Capping value gamma, to avoid infty, and the width delta of the
+		// transition to it.
+		struct Capping
+		{
+			T gamma, delta, low, high;
+
+			Capping()
+			{
+				gamma = std::numeric_limits<T>::max() / 2.;
+
+				// delta chosen to be a number small yet still significant with
+				// respect to gamma.
+				delta = gamma / std::pow(T(2), T(std::numeric_limits<T>::digits));
+				assert(gamma + delta > gamma);
+				assert(gamma - delta < gamma);
+
+				low  = 1/(gamma-delta);
+				high = 1/(gamma+delta);
+			}
+		};
 
+		static const Capping &capping()
+		{
+			static const Capping c;
+			return c;
+		}
+
+		static T capped(const T val_inv, const Capping &c)
+		{
 			// We do the case distinction here instead of in s to avoid computing 1/0
 			// Because val_inv = 1/f in report eqn. (32), we must invert the inequalities
-			return   (val_inv >= 1/(gamma-delta)) ?   1/val_inv :
-				((val_inv >= 1/(gamma+delta)) ? s(1/val_inv, gamma, delta) : gamma);
+			return   (val_inv >= c.low) ?   1/val_inv :
+				((val_inv >= c.high) ? s(1/val_inv, c.gamma, c.delta) : c.gamma);
 		}
 
 		static T s(const T x, const T gamma, const T delta)
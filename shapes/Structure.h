@@ -21,7 +21,10 @@
 #ifndef SHAPES_STRUCTURE_H
 #define SHAPES_STRUCTURE_H 1
 
+#include <algorithm>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <shapes/tinyxml.h>
 
@@ -30,6 +33,9 @@
 namespace shapes
 {
 
+template <typename T>
+class CompiledShape;
+
 template <typename T>
 class Structure
 {
@@ -48,12 +54,85 @@ class Structure
 		{
 			const T v = this->rawValue(p);
 
-			if (dampLow != T(1.0) || dampHigh != T(1.0))
+			if (this->isDamped())
 				return this->damp(v, 1.-dampLow, dampHigh);
 
 			return v;
 		}
 
+		static T dampValue(const T v, const T dLow, const T dHigh)
+		{ return damp(v, 1.-dLow, dHigh); }
+
+		// Number of points evaluated per call to rawValues(); composite
+		// structures pass the values of their children down in arrays of
+		// this size.
+		static const std::size_t blockSize = 64;
+
+		// Evaluate n points at once.
+		void values(const FPPoint * const pts, T * const out, const std::size_t n) const
+		{
+			const bool damped = this->isDamped();
+			for (std::size_t i = 0; i < n; i += blockSize)
+			{
+				const std::size_t m = std::min(blockSize, n - i);
+				this->rawValues(pts + i, out + i, m);
+
+				if (damped)
+					for (std::size_t j = i; j < i + m; ++j)
+						out[j] = this->damp(out[j], 1.-dampLow, dampHigh);
+			}
+		}
+
+		// Evaluate n points on a grid row: first, first + step, ...
+		void values(const FPPoint &first, const FPVector &step,
+			    T * const out, const std::size_t n) const
+		{
+			FPPoint pts[blockSize];
+			for (std::size_t i = 0; i < n; i += blockSize)
+			{
+				const std::size_t m = std::min(blockSize, n - i);
+				for (std::size_t j = 0; j < m; ++j)
+					pts[j] = first + step * T(i + j);
+				this->values(pts, out + i, m);
+			}
+		}
+
+		/*
+		 * Whether value(p) >= 1. Composite structures stop evaluating
+		 * their children once that is certain; the answer may differ
+		 * from value(p) >= 1 only where the value is within rounding
+		 * of 1. Damping does not change which side of 1 a value is on.
+		 */
+		bool inside(const FPPoint &p) const
+		{
+			bool in;
+			this->rawInside(&p, &in, 1u);
+			return in;
+		}
+
+		void inside(const FPPoint * const pts, bool * const out, const std::size_t n) const
+		{
+			for (std::size_t i = 0; i < n; i += blockSize)
+				this->rawInside(pts + i, out + i, std::min(blockSize, n - i));
+		}
+
+		// Classify n points on a grid row: first, first + step, ...
+		void inside(const FPPoint &first, const FPVector &step,
+			    bool * const out, const std::size_t n) const
+		{
+			FPPoint pts[blockSize];
+			for (std::size_t i = 0; i < n; i += blockSize)
+			{
+				const std::size_t m = std::min(blockSize, n - i);
+				for (std::size_t j = 0; j < m; ++j)
+					pts[j] = first + step * T(i + j);
+				this->rawInside(pts, out + i, m);
+			}
+		}
+
+		// Rough cost of evaluating a point, relative to a Sphere
+		virtual T cost() const { return T(1); }
+
 		virtual bool fromXML(TiXmlHandle &root) = 0;
 
 		virtual TiXmlElement * const toXML() const = 0;
@@ -61,11 +140,27 @@ class Structure
 		virtual void getBoundingBox(FPPoint &_minCorner,
 					    FPPoint &_maxCorner) const = 0;
 
+		/*
+		 * A box outside of which value() is exactly zero, because it is
+		 * damped to zero there; false if there is no such box.
+		 */
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const
+		{ return false; }
+
 		virtual void print(unsigned indent = 0) const = 0;
 
+		// Append instructions that leave the value of this structure in
+		// the given slot. By default, the structure is called as a whole
+		// for each block of points.
+		virtual void compile(CompiledShape<T> &compiled, const unsigned slot) const
+		{ compiled.emitLeaf(this, slot); }
+
 		void setDamping(const T dLow, const T dHigh)
 		{ dampLow = dLow; dampHigh = dHigh;}
 
+		T getDampLow()  const { return dampLow; }
+		T getDampHigh() const { return dampHigh; }
+
 		void setName(const std::string new_name) { name_ = new_name; }
 
 		const std::string &name() const { return name_; }
@@ -73,6 +168,23 @@ class Structure
 	protected:
 		T dampLow, dampHigh;
 
+		bool isDamped() const
+		{ return dampLow != T(1.0) || dampHigh != T(1.0); }
+
+		// Raw values below this are damped to exactly zero; zero if the
+		// structure vanishes nowhere.
+		T supportLevel() const
+		{ return (dampLow > T(0) && dampLow < T(1)) ? T(1) - dampLow : T(0); }
+
+		// Relative margin on supports, for rounding
+		static T supportMargin() { return T(1e-4); }
+
+		void compileDamping(CompiledShape<T> &compiled, const unsigned slot) const
+		{
+			if (this->isDamped())
+				compiled.emitDamping(slot, dampLow, dampHigh);
+		}
+
 		static void printIndented(std::string s, unsigned indent)
 		{
 			for (unsigned i = 0; i < indent; ++i)
@@ -82,6 +194,35 @@ class Structure
 
 		virtual T rawValue(const FPPoint &p) const = 0;
 
+		// At most blockSize points; structures override this to avoid
+		// a virtual call per point.
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const
+		{
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = this->rawValue(pts[i]);
+		}
+
+		// At most blockSize points; by default from rawValues().
+		virtual void rawInside(const FPPoint * const pts, bool * const out,
+				       const std::size_t n) const
+		{
+			T values[blockSize];
+			this->rawValues(pts, values, n);
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = values[i] >= T(1);
+		}
+
+		// Pairs of cost and index of the given structures, cheapest first
+		static void orderByCost(const std::vector<Structure<T> *> &structures,
+					std::vector<std::pair<T, std::size_t> > &order)
+		{
+			order.resize(structures.size());
+			for (std::size_t i = 0; i < structures.size(); ++i)
+				order[i] = std::make_pair(structures[i]->cost(), i);
+			std::sort(order.begin(), order.end());
+		}
+
 	private:
 		std::string name_;
 
@@ -174,6 +315,9 @@ class Structure
 		{ return damp_exp(y, eps, T(1.0-eps), exp_high); }
 };
 
+template <typename T>
+const std::size_t Structure<T>::blockSize;
+
 } // end namespace
 
 #endif
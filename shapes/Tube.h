@@ -31,11 +31,6 @@
 #include <shapes/SphericStructure.h>
 #include <shapes/Point.h>
 
-#ifdef USE_GSL
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_poly.h>
-#endif
-
 namespace shapes
 {
 
@@ -46,22 +41,16 @@ class Tube : public SphericStructure<T>
 		typedef typename Structure<T>::FPPoint  FPPoint;
 		typedef typename Structure<T>::FPVector FPVector;
 
-		Tube(const std::string name__ = "") : SphericStructure<T>(name__)
-		{
-			#ifdef USE_GSL
-			gsl_set_error_handler_off();
-			#endif
-		}
+		Tube(const std::string name__ = "") :
+			SphericStructure<T>(name__), uniform(false), unitWeight(false),
+			tolerance(0), deviation(0) { }
 
 		Tube(const std::vector<Point<T> > &_points, const std::string name__ = "") :
-			SphericStructure<T>(name__), points(_points)
+			SphericStructure<T>(name__), points(_points), uniform(false),
+			unitWeight(false), tolerance(0), deviation(0)
 		{
 			if (!this->generateTubes(points))
 				std::cout << "Tube: Generation of splines failed." << std::endl;
-
-			#ifdef USE_GSL
-			gsl_set_error_handler_off();
-			#endif
 		}
 
 		bool set(const std::vector<Point<T> > &_points)
@@ -72,6 +61,24 @@ class Tube : public SphericStructure<T>
 
 		const std::vector<Point<T> > &getPoints() const { return points; }
 
+		/*
+		 * Approximate the axis of the tube by straight pieces that are
+		 * at most 'tolerance' away from it, and find closest points on
+		 * those instead of solving for them exactly; zero means exact.
+		 * Only segments straight enough for a few pieces are
+		 * approximated, others are faster to search exactly. The other
+		 * properties of the tube are evaluated exactly at the closest
+		 * point found.
+		 */
+		bool setTolerance(const T _tolerance);
+
+		T getTolerance() const { return tolerance; }
+
+		// Largest distance of the straight pieces to the axis, at most
+		// the tolerance; the surface of a tube with unit weights moves
+		// by no more than this.
+		T getDeviation() const { return deviation; }
+
 		virtual ~Tube() { }
 
 		virtual bool fromXML(TiXmlHandle &root);
@@ -98,13 +105,20 @@ class Tube : public SphericStructure<T>
 			}
 		}
 
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
 		virtual void print(unsigned indent) const;
 
+		// A closest point search per segment that is not skipped
+		virtual T cost() const { return T(1) + T(4) * T(coefficients.size()); }
+
                 bool empty() const { return points.empty(); }
 
 
 	private:
 		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
 
 		std::vector<Point<T> >		points;
 
@@ -117,23 +131,113 @@ class Tube : public SphericStructure<T>
 		cvmlcpp::NaturalCubicSpline<T, 1>	 radius;
 //		mutable T 			cachedT;
 
+		// Per segment: the box around the control polygon of the center,
+		// which contains the segment, and bounds on weight, radius and
+		// exponent. Together they bound the value of the segment at a
+		// distance from the box.
+		struct SegmentBounds
+		{
+			FPPoint lower, upper;
+			// (largest weight * largest radius)^2
+			T scaleSq;
+			// x^(emax/2) and x^(emin/2)
+			Power<T> nearPower, farPower;
+		};
+		std::vector<SegmentBounds> bounds;
+
+		// Coefficients of the splines of a segment, lowest degree first,
+		// component by component; and those of the derivative of
+		// |center(t) - center(0)|^2.
+		struct SegmentCoefficients
+		{
+			T center[3][4];
+			T weight[3][4];
+			T rotVector[3][4];
+			T angle[4], exponent[4], radius[4];
+			T derivativeSq[6];
+			// Points closer than this to all of the segment have a
+			// single closest point, see findTSegment().
+			T straightRangeSq;
+			// Orientation frames at t = 0, 1/frameSteps, ..., 1, starting
+			// at frames[frame]; none if the segment is not rotated.
+			std::size_t frame;
+			unsigned frameSteps;
+			// Ends of the straight pieces along the axis, as t, x, y, z,
+			// starting at knots[knot]; none if the segment is searched
+			// exactly.
+			std::size_t knot;
+			unsigned pieces;
+		};
+		std::vector<SegmentCoefficients> coefficients;
+
+		// Orientation frames of rotated segments, 9 values each
+		std::vector<T> frames;
+
+		// Weight, radius and x^(exponent/2), if the same everywhere
+		bool uniform, unitWeight;
+		FPVector uniformWeight;
+		T uniformRadius;
+		Power<T> uniformHalfPower;
+
+		T tolerance, deviation;
+		std::vector<T> knots;
+
+		// Fill 'knots' for the current tolerance, with up to maxPieces
+		// pieces per segment.
+		enum { maxPieces = 4 };
+		void generatePieces();
+
+		// Largest error of an interpolated frame, and the finest
+		// resolution used to reach it.
+		static T frameTolerance() { return T(1e-6); }
+		enum { maxFrameSteps = 256 };
+
+		// Orientation of a segment at t, from its rotation vector and angle
+		bool frameAt(const SegmentCoefficients &c, const T t,
+			     FPVector orientation[3]) const;
+
+		// Largest error of blending frames at the resolution of c
+		T frameError(const SegmentCoefficients &c) const;
+
 		bool generateTubes(const std::vector<Point<T> > &points);
 
+		// Fill 'coefficients' and 'bounds' from the splines
+		void precompute();
+
+		// Upper bound on the value of a segment for points at squared
+		// distance distSq or more from its box.
+		T valueBound(const SegmentBounds &b, const T distSq) const;
+
 //		void getDerivative(const T &t, FPVector &v) const;
-		cvmlcpp::Polynomial<T, 6>
-		distSqPoly(const std::size_t segment, const FPPoint &p) const;
+		// Coefficients of the derivative of the squared distance from
+		// p to the center of the segment, a 5th degree polynomial.
+		void distSqDerivative(const std::size_t segment, const FPPoint &p,
+				      T a[6]) const;
 
-		T segmentValue(const std::size_t segment, const FPPoint &p) const;
+		FPPoint centerAt(const std::size_t segment, const T t) const;
 
-		bool updateMinDistSq(const std::size_t segment, const FPPoint &p,
-					const T &t, T &minDistSq, T &best) const;
+		// 'hint' is the closest point on the segment to a nearby point,
+		// or -1 if unknown; it is replaced by the one for p.
+		T segmentValue(const std::size_t segment, const FPPoint &p, T &hint) const;
+
+		// segmentValue() using the straight pieces of the segment
+		T approximateSegmentValue(const std::size_t segment, const FPPoint &p) const;
+
+		// Project p onto a piece; true if closer than minDistSq, which
+		// is then updated along with t and closest = center(t) - p.
+		bool updateClosestPiece(const SegmentCoefficients &c, const unsigned piece,
+					const FPPoint &p, T &minDistSq, T &t,
+					T closest[3]) const;
 
-		bool findTSegment(const std::size_t segment, const FPPoint &p, T &t) const;
+		// Value of a segment at p with closest point t on the axis, and
+		// cp = center(t) - p.
+		T pointValue(const std::size_t segment, const T t, const FPVector &cp) const;
 
+		bool updateMinDistSq(const std::size_t segment, const FPPoint &p,
+					const T &t, T &minDistSq, T &best) const;
 
-		bool findTSegment_NewtonRaphson(const std::size_t segment,
-			const FPPoint &p, T &t,
-			const cvmlcpp::Polynomial<T, 5> &derivativeDistSq) const;
+		bool findTSegment(const std::size_t segment, const FPPoint &p, T &t,
+				  const T hint = -1) const;
 
 };
 
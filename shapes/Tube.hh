@@ -18,36 +18,124 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <limits>
 
 #include <boost/lexical_cast.hpp>
 
 #include <cvmlcpp/base/StringTools>
 
 #include "Point.h"
+#include "Roots.h"
 
 namespace shapes
 {
 
+namespace detail
+{
+
+// Range of a cubic a0 + a1 t + a2 t^2 + a3 t^3 on [0, 1], from its
+// Bernstein coefficients; the cubic lies within their hull.
+template <typename T>
+void cubicRange(const T a0, const T a1, const T a2, const T a3, T &lo, T &hi)
+{
+	const T b[4] = { a0, a0 + a1/T(3), a0 + (T(2)*a1 + a2)/T(3), a0 + a1 + a2 + a3 };
+	lo = *std::min_element(b, b + 4);
+	hi = *std::max_element(b, b + 4);
+}
+
+// a[0] + a[1] t + a[2] t^2 + a[3] t^3
 template <typename T>
-cvmlcpp::Polynomial<T, 6>
-Tube<T>::distSqPoly(const std::size_t segment, const FPPoint &p) const
+T horner(const T a[4], const T t)
 {
-	cvmlcpp::Polynomial<T, 6> distSq;
-	std::fill(distSq.begin(), distSq.end(), 0);
+	return ((a[3] * t + a[2]) * t + a[1]) * t + a[0];
+}
 
-	const cvmlcpp::Polynomial<FPPoint, 3> d = center[segment] - p;
-	cvmlcpp::Polynomial<FPPoint, 6> dSq = d * d;
-	for (unsigned t = 0u; t <= 6u; ++t)
-			distSq[t] = dSq[t][X] + dSq[t][Y] + dSq[t][Z];
+// Squared distance from p to the point at c[0], c[1], c[2]
+template <typename T>
+T distSq(const T * const c, const typename EuclidTypes<T>::FPPoint &p)
+{
+	const T x = c[0] - p[0];
+	const T y = c[1] - p[1];
+	const T z = c[2] - p[2];
+
+	return x*x + y*y + z*z;
+}
+
+// Squared distance between two boxes, 0 if they overlap
+template <typename T>
+T boxDistSq(const typename EuclidTypes<T>::FPPoint &lower0,
+	    const typename EuclidTypes<T>::FPPoint &upper0,
+	    const typename EuclidTypes<T>::FPPoint &lower1,
+	    const typename EuclidTypes<T>::FPPoint &upper1)
+{
+	T distSq = 0;
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		const T gap = std::max(std::max(lower1[d] - upper0[d],
+						lower0[d] - upper1[d]), T(0));
+		distSq += gap * gap;
+	}
 
 	return distSq;
 }
 
+} // end namespace detail
+
+template <typename T>
+void Tube<T>::distSqDerivative(const std::size_t segment, const FPPoint &p,
+			       T a[6]) const
+{
+	// With e(t) = center(t) - center(0) and q = p - center(0), the squared
+	// distance is |e(t)|^2 - 2 q.e(t) + |q|^2. Only the middle term
+	// depends on both p and t.
+	const SegmentCoefficients &c = coefficients[segment];
+	const T q[3] = { p[X] - c.center[X][0], p[Y] - c.center[Y][0],
+			 p[Z] - c.center[Z][0] };
+
+	std::copy(c.derivativeSq, c.derivativeSq + 6, a);
+	for (unsigned k = 1u; k <= 3u; ++k)
+		a[k-1] -= T(2*k) * (q[X] * c.center[X][k] + q[Y] * c.center[Y][k] +
+				    q[Z] * c.center[Z][k]);
+}
+
+template <typename T>
+typename Tube<T>::FPPoint Tube<T>::centerAt(const std::size_t segment, const T t) const
+{
+	const SegmentCoefficients &c = coefficients[segment];
+
+	return FPPoint(detail::horner(c.center[X], t), detail::horner(c.center[Y], t),
+		       detail::horner(c.center[Z], t));
+}
+
 template <typename T>
 T Tube<T>::rawValue(const FPPoint &p) const
+{
+	// The maximum of the contributions of the segments; segments whose
+	// bound does not exceed it are skipped.
+	T val = -1.0;
+	for (std::size_t segment = 0; segment < center.size(); ++segment)
+	{
+		const SegmentBounds &b = bounds[segment];
+		if (this->valueBound(b, detail::boxDistSq<T>(p, p, b.lower, b.upper)) <= val)
+			continue;
+		T hint = -1.0;
+		val = std::max(val, (coefficients[segment].pieces > 0u) ?
+			this->approximateSegmentValue(segment, p) :
+			this->segmentValue(segment, p, hint));
+	}
+
+	assert( (points.size() == 0u) || (val >= 0.0) );
+
+	return val;
+}
+
+template <typename T>
+void Tube<T>::rawValues(const FPPoint * const pts, T * const out,
+			const std::size_t n) const
 {
 	assert(weight.size() == center.size());
 /*	assert(orientation[X].size() == center.size());
@@ -57,61 +145,246 @@ T Tube<T>::rawValue(const FPPoint &p) const
 	assert(angle.size() == center.size());
 	assert(exponent.size() == center.size());
 	assert(radius.size() == center.size());
+	assert(bounds.size() == center.size());
 
 	// Of each tube, the maximum of the contributions of the
 	// segments is taken as contribution of the tube to the point.
-	T val = -1.0;
-	for (std::size_t segment = 0; segment < center.size(); ++segment)
-		val = std::max(val, this->segmentValue(segment, p));
+	std::fill(out, out + n, T(-1.0));
+	if (n == 0u)
+		return;
+
+	// Box around the points
+	FPPoint lower = pts[0];
+	FPPoint upper = pts[0];
+	for (std::size_t i = 1; i < n; ++i)
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], pts[i][d]);
+			upper[d] = std::max(upper[d], pts[i][d]);
+		}
 
-	assert( (points.size() == 0u) || (val >= 0.0) );
+	// In batches of at most blockSize, segments that may contribute
+	// most come first, so that the others in the batch can be skipped
+	// once their bound is reached. Tubes rarely have more segments than
+	// one batch.
+	std::pair<T, std::size_t> order[Structure<T>::blockSize];
+	for (std::size_t first = 0; first < center.size(); first += Structure<T>::blockSize)
+	{
+		const std::size_t count = std::min(std::size_t(Structure<T>::blockSize),
+						   center.size() - first);
+		for (std::size_t k = 0; k < count; ++k)
+		{
+			const SegmentBounds &b = bounds[first + k];
+			order[k].first = -this->valueBound(b,
+				detail::boxDistSq<T>(lower, upper, b.lower, b.upper));
+			order[k].second = first + k;
+		}
+		std::sort(order, order + count);
+
+		// Segment by segment, so that the coefficients of one segment
+		// are used for the entire block of points. Points in a block
+		// are usually neighbours on a grid, with nearly the same
+		// closest point on the segment; the search for the next point
+		// starts there.
+		for (std::size_t k = 0; k < count; ++k)
+		{
+			if (-order[k].first <= *std::min_element(out, out + n))
+				break;
+
+			const std::size_t segment = order[k].second;
+			const SegmentBounds &b = bounds[segment];
+			T hint = -1.0;
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				if (this->valueBound(b, detail::boxDistSq<T>(pts[i], pts[i],
+							b.lower, b.upper)) <= out[i])
+					continue;
+				out[i] = std::max(out[i], (coefficients[segment].pieces > 0u) ?
+					this->approximateSegmentValue(segment, pts[i]) :
+					this->segmentValue(segment, pts[i], hint));
+			}
+		}
+	}
 
-	return val;
+	assert( (points.size() == 0u) || (*std::min_element(out, out + n) >= 0.0) );
 }
 
 template <typename T>
-T Tube<T>::segmentValue(const std::size_t segment, const FPPoint &p) const
+bool Tube<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	const T eps = this->supportLevel();
+	if (!(eps > T(0)) || bounds.empty())
+		return false;
+
+	lower =  std::numeric_limits<T>::max();
+	upper = -std::numeric_limits<T>::max();
+	for (typename std::vector<SegmentBounds>::const_iterator b = bounds.begin();
+	     b != bounds.end(); ++b)
+	{
+		// valueBound() is below eps from q = distSq / scaleSq =
+		// eps^(-2/emin) on, where emin / 2 is the exponent of farPower.
+		const T halfExponent = b->farPower.exponent();
+		if (!(halfExponent > T(0)))
+			return false;
+		const T distance = std::sqrt(b->scaleSq) * std::pow(eps, T(-0.5) / halfExponent) *
+				   (T(1) + Structure<T>::supportMargin());
+
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], b->lower[d] - distance);
+			upper[d] = std::max(upper[d], b->upper[d] + distance);
+		}
+	}
+
+	return true;
+}
+
+template <typename T>
+T Tube<T>::valueBound(const SegmentBounds &b, const T distSq) const
+{
+	// The weighted distance to the axis is at least the distance to the
+	// box divided by the largest weight; slightly reduced for rounding.
+	const T q = distSq * (T(1) - T(256) * std::numeric_limits<T>::epsilon()) / b.scaleSq;
+
+	// The sphere value (r^2 / distSq)^(e/2) is largest for the largest
+	// exponent close to the axis, and for the smallest further out.
+	return SphericStructure<T>::capped( (q < T(1)) ? b.nearPower(q) : b.farPower(q) );
+}
+
+template <typename T>
+T Tube<T>::segmentValue(const std::size_t segment, const FPPoint &p, T &hint) const
 {
 	T t;
-	if (!this->findTSegment(segment, p, t)) // No valid closest point
+	if (!this->findTSegment(segment, p, t, hint)) // No valid closest point
+	{
+		hint = -1.0;
 		return T(0);
+	}
+	hint = t;
 
 	assert(t >= 0.0);
 	assert(t <= 1.0);
 
-	// Splines<T> require the segment number to be included
-	t += segment;
+	// Compute point on axis 'c', and vector c-p
+	return this->pointValue(segment, t, this->centerAt(segment, t) - p);
+}
+
+template <typename T>
+T Tube<T>::approximateSegmentValue(const std::size_t segment, const FPPoint &p) const
+{
+	const SegmentCoefficients &c = coefficients[segment];
+
+	// Closest point on the straight pieces
+	T minDistSq = std::numeric_limits<T>::max();
+	T t = 0;
+	T closest[3] = { 0, 0, 0 };
+	for (unsigned piece = 0; piece < c.pieces; ++piece)
+		this->updateClosestPiece(c, piece, p, minDistSq, t, closest);
+
+	const FPVector cp(closest[X], closest[Y], closest[Z]);
+	return this->pointValue(segment, t, cp);
+}
+
+template <typename T>
+bool Tube<T>::updateClosestPiece(const SegmentCoefficients &c, const unsigned piece,
+				 const FPPoint &p, T &minDistSq, T &t, T closest[3]) const
+{
+	const T * const k0 = &knots[c.knot + 4u*piece];
+	const T * const k1 = k0 + 4u;
+	T ab[3], ap[3];
+	for (unsigned d = 0; d < 3u; ++d)
+	{
+		ab[d] = k1[d+1] - k0[d+1];
+		ap[d] = p[d] - k0[d+1];
+	}
+	const T lengthSq = ab[X]*ab[X] + ab[Y]*ab[Y] + ab[Z]*ab[Z];
+	const T dot = ap[X]*ab[X] + ap[Y]*ab[Y] + ap[Z]*ab[Z];
+	const T s = (lengthSq > T(0)) ?
+		std::min(std::max(dot / lengthSq, T(0)), T(1)) : T(0);
+
+	T dist[3];
+	for (unsigned d = 0; d < 3u; ++d)
+		dist[d] = ab[d] * s - ap[d];
+	const T distSq = dist[X]*dist[X] + dist[Y]*dist[Y] + dist[Z]*dist[Z];
+	if (!(distSq < minDistSq))
+		return false;
+
+	minDistSq = distSq;
+	t = k0[0] + s * (k1[0] - k0[0]);
+	std::copy(dist, dist + 3, closest);
+
+	return true;
+}
+
+template <typename T>
+T Tube<T>::pointValue(const std::size_t segment, const T t, const FPVector &cp) const
+{
+	const SegmentCoefficients &c = coefficients[segment];
+
+	// Round tubes of constant thickness
+	if (uniform && c.frameSteps == 0u)
+	{
+		if (unitWeight)
+			return this->sphereValue(cp[X]*cp[X] + cp[Y]*cp[Y] + cp[Z]*cp[Z],
+						 uniformHalfPower, uniformRadius);
+
+		const T x = cp[X] / uniformWeight[X];
+		const T y = cp[Y] / uniformWeight[Y];
+		const T z = cp[Z] / uniformWeight[Z];
+
+		return this->sphereValue(x*x+y*y+z*z, uniformHalfPower, uniformRadius);
+	}
 
 	// Get the normalized weights
-	const FPVector weightt = weight(t);
+	const FPVector weightt(detail::horner(c.weight[X], t),
+			       detail::horner(c.weight[Y], t),
+			       detail::horner(c.weight[Z], t));
 	assert( std::abs(cvmlcpp::modulus(weightt)-std::sqrt(T(3))) < 0.00001 );
 	assert(weightt[X] > 0.);
 	assert(weightt[Y] > 0.);
 	assert(weightt[Z] > 0.);
 
-	// Compute point on axis 'c', and vector c-p
-	const FPVector cp = this->center(t) - p;
+	const T e = detail::horner(c.exponent, t);
+	const T r = detail::horner(c.radius, t);
+	assert(e > 0.0);
+	assert(r > 0);
 
-	const T a = this->angle(t);
-	FPVector rv = this->rotVector(t);
-	assert(std::abs(cvmlcpp::modulus(rv)-1) < 0.00001);
+	// Unrotated segments use the axes as they are
+	if (c.frameSteps == 0u)
+	{
+		const T x = cp[X] / weightt[X];
+		const T y = cp[Y] / weightt[Y];
+		const T z = cp[Z] / weightt[Z];
+
+		return this->sphereValue(x*x+y*y+z*z, e, r);
+	}
+
+	// Blend the nearest frames of the table
+	const T u = t * c.frameSteps;
+	const unsigned i = std::min(static_cast<unsigned>(u), c.frameSteps - 1u);
+	const T f = u - i;
+	const T * const frame0 = &frames[c.frame + 9u*i];
+	const T * const frame1 = frame0 + 9u;
 	FPVector orientation[3];
-	Point<T>::recomputeOrientation(rv, a, orientation);
+	for (unsigned k = 0; k < 3u; ++k)
+	{
+		for (unsigned d = 0; d < 3u; ++d)
+			orientation[k][d] = frame0[3u*k + d] +
+				f * (frame1[3u*k + d] - frame0[3u*k + d]);
+		orientation[k] /= cvmlcpp::modulus(orientation[k]);
+	}
 
 	assert(std::abs(cvmlcpp::modulus(orientation[X])-1) < 0.00001);
 	assert(std::abs(cvmlcpp::modulus(orientation[Y])-1) < 0.00001);
 	assert(std::abs(cvmlcpp::modulus(orientation[Z])-1) < 0.00001);
 
-	assert(this->exponent(t) > 0.0);
-	assert(this->radius(t) > 0);
-
 	const T x = cvmlcpp::dotProduct(cp, orientation[X]) / (weightt[X]);
 	const T y = cvmlcpp::dotProduct(cp, orientation[Y]) / (weightt[Y]);
 	const T z = cvmlcpp::dotProduct(cp, orientation[Z]) / (weightt[Z]);
 
 	const T distSq = x*x+y*y+z*z;
 
-	return this->sphereValue(distSq, this->exponent(t), this->radius(t));
+	return this->sphereValue(distSq, e, r);
 }
 
 template <typename T>
@@ -132,6 +405,17 @@ bool Tube<T>::fromXML(TiXmlHandle &root)
 	if ( (elem = root.FirstChildElement("DampHigh").ToElement()) )
 		this->dampHigh = lexical_cast<T>(elem->GetText());
 
+	tolerance = 0;
+	if ( (elem = root.FirstChildElement("Tolerance").ToElement()) )
+	{
+		tolerance = lexical_cast<T>(elem->GetText());
+		if (!(tolerance >= T(0)))
+		{
+			std::cout << "Tube: Tolerance must not be negative." << std::endl;
+			return false;
+		}
+	}
+
 	for (TiXmlElement * elem = root.FirstChildElement("Point").ToElement();
 	     elem; elem = elem->NextSiblingElement("Point") )
 	{
@@ -193,6 +477,14 @@ TiXmlElement * const Tube<T>::toXML() const
 		root->LinkEndChild(dampHighElem);
 	}
 
+	if (tolerance != 0)
+	{
+		std::string buf = lexical_cast<std::string>(tolerance);
+		TiXmlElement * const toleranceElem = new TiXmlElement("Tolerance");
+		toleranceElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(toleranceElem);
+	}
+
 	for (typename std::vector<Point<T> >::const_iterator p = points.begin();
 	     p != points.end(); ++p)
 		root->LinkEndChild(p->toXML("Point"));
@@ -218,6 +510,12 @@ void Tube<T>::print(unsigned indent) const
 		Structure<T>::printIndented(buf, indent + 1);
 	}
 
+	if (tolerance != 0)
+	{
+		buf = "<Tolerance>"+boost::lexical_cast<std::string>(tolerance)+"</Tolerance>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
 	if (!this->name().empty())
 	{
 		buf = "<Name>"+this->name()+"</Name>";
@@ -304,9 +602,253 @@ bool Tube<T>::generateTubes(const std::vector<Point<T> > &points)
 		values.push_back(point->getExponent());
 	exponent.init(values.begin(), values.end());
 
+	this->precompute();
+
 	return true;
 }
 
+template <typename T>
+void Tube<T>::precompute()
+{
+	coefficients.resize(center.size());
+	bounds.resize(center.size());
+	frames.clear();
+	for (std::size_t segment = 0; segment < center.size(); ++segment)
+	{
+		SegmentCoefficients &c = coefficients[segment];
+		for (unsigned k = 0; k <= 3u; ++k)
+		{
+			for (unsigned d = 0; d < 3u; ++d)
+			{
+				c.center[d][k]    = center[segment][k][d];
+				c.weight[d][k]    = weight[segment][k][d];
+				c.rotVector[d][k] = rotVector[segment][k][d];
+			}
+			c.angle[k]    = angle[segment][k];
+			c.exponent[k] = exponent[segment][k];
+			c.radius[k]   = radius[segment][k];
+		}
+
+		// |center(t) - center(0)|^2 has coefficients sq[m], m = 2..6;
+		// its derivative m * sq[m] t^(m-1).
+		T sq[7] = { 0, 0, 0, 0, 0, 0, 0 };
+		for (unsigned j = 1u; j <= 3u; ++j)
+			for (unsigned k = 1u; k <= 3u; ++k)
+				for (unsigned d = 0; d < 3u; ++d)
+					sq[j+k] += c.center[d][j] * c.center[d][k];
+		for (unsigned m = 1u; m <= 6u; ++m)
+			c.derivativeSq[m-1] = T(m) * sq[m];
+
+		// Half the second derivative of the squared distance to p is
+		// |center'|^2 + center''.(center - p); it is positive, and the
+		// first derivative increasing, if |center - p| stays below
+		// min |center'|^2 / max |center''|. The minimum is bounded by
+		// the Bernstein coefficients of |center'|^2, center'' is linear.
+		T speedSq[5] = { 0, 0, 0, 0, 0 };
+		for (unsigned j = 1u; j <= 3u; ++j)
+			for (unsigned k = 1u; k <= 3u; ++k)
+				for (unsigned d = 0; d < 3u; ++d)
+					speedSq[j+k-2] += T(j * k) * c.center[d][j] * c.center[d][k];
+		const detail::BernsteinBasis<4, T> &basis = detail::BernsteinBasis<4, T>::instance();
+		T minSpeedSq = std::numeric_limits<T>::max();
+		for (unsigned k = 0; k <= 4u; ++k)
+		{
+			T b = speedSq[0];
+			for (unsigned i = 1u; i <= k; ++i)
+				b += basis.m[k][i] * speedSq[i];
+			minSpeedSq = std::min(minSpeedSq, b);
+		}
+
+		T maxSecondSq = 0;
+		for (unsigned k = 0; k <= 1u; ++k)
+		{
+			T secondSq = 0;
+			for (unsigned d = 0; d < 3u; ++d)
+			{
+				const T second = T(2) * c.center[d][2] + T(6 * k) * c.center[d][3];
+				secondSq += second * second;
+			}
+			maxSecondSq = std::max(maxSecondSq, secondSq);
+		}
+
+		if (!(minSpeedSq > T(0)))
+			c.straightRangeSq = 0;
+		else if (maxSecondSq > T(0))
+			// Reduced slightly for rounding
+			c.straightRangeSq = T(0.99) * minSpeedSq * minSpeedSq / maxSecondSq;
+		else
+			c.straightRangeSq = std::numeric_limits<T>::max();
+
+		// A table of orientation frames, fine enough that blending
+		// neighbours is within frameTolerance() of the exact frame.
+		c.frame = frames.size();
+		c.frameSteps = 0u;
+		if (c.angle[0] != 0 || c.angle[1] != 0 || c.angle[2] != 0 || c.angle[3] != 0)
+		{
+			for (c.frameSteps = 1u; c.frameSteps < unsigned(maxFrameSteps); c.frameSteps *= 2u)
+				if (this->frameError(c) <= frameTolerance())
+					break;
+
+			for (unsigned i = 0; i <= c.frameSteps; ++i)
+			{
+				FPVector orientation[3];
+				this->frameAt(c, T(i) / T(c.frameSteps), orientation);
+				for (unsigned k = 0; k < 3u; ++k)
+					for (unsigned d = 0; d < 3u; ++d)
+						frames.push_back(orientation[k][d]);
+			}
+		}
+
+		SegmentBounds &b = bounds[segment];
+		T lo, hi;
+
+		for (unsigned d = 0; d < 3u; ++d)
+			detail::cubicRange(c.center[d][0], c.center[d][1], c.center[d][2],
+					   c.center[d][3], b.lower[d], b.upper[d]);
+
+		T maxWeight = 0;
+		for (unsigned d = 0; d < 3u; ++d)
+		{
+			detail::cubicRange(c.weight[d][0], c.weight[d][1], c.weight[d][2],
+					   c.weight[d][3], lo, hi);
+			maxWeight = std::max(maxWeight, hi);
+		}
+
+		detail::cubicRange(c.radius[0], c.radius[1], c.radius[2], c.radius[3], lo, hi);
+		b.scaleSq = (maxWeight * hi) * (maxWeight * hi);
+
+		detail::cubicRange(c.exponent[0], c.exponent[1], c.exponent[2],
+				   c.exponent[3], lo, hi);
+		b.nearPower.set(hi * T(0.5));
+		b.farPower.set(lo * T(0.5));
+	}
+
+	// Are weight, radius and exponent the same everywhere ? Decided on
+	// the coefficients, so that the shortcut gives identical values.
+	uniform = !coefficients.empty();
+	for (std::size_t segment = 0; uniform && segment < coefficients.size(); ++segment)
+	{
+		const SegmentCoefficients &c = coefficients[segment];
+		const SegmentCoefficients &first = coefficients[0];
+		for (unsigned k = 0; k <= 3u; ++k)
+		{
+			const T constant = (k == 0u) ? T(1) : T(0);
+			for (unsigned d = 0; d < 3u; ++d)
+				uniform = uniform && (c.weight[d][k] == constant * first.weight[d][0]);
+			uniform = uniform && (c.radius[k]   == constant * first.radius[0]) &&
+					     (c.exponent[k] == constant * first.exponent[0]);
+		}
+	}
+	if (uniform)
+	{
+		const SegmentCoefficients &first = coefficients[0];
+		for (unsigned d = 0; d < 3u; ++d)
+			uniformWeight[d] = first.weight[d][0];
+		unitWeight = (uniformWeight[X] == T(1) && uniformWeight[Y] == T(1) &&
+			      uniformWeight[Z] == T(1));
+		uniformRadius = first.radius[0];
+		uniformHalfPower.set(first.exponent[0] * T(0.5));
+	}
+
+	this->generatePieces();
+}
+
+template <typename T>
+bool Tube<T>::setTolerance(const T _tolerance)
+{
+	if (!(_tolerance >= T(0)))
+		return false;
+
+	tolerance = _tolerance;
+	this->generatePieces();
+
+	return true;
+}
+
+template <typename T>
+void Tube<T>::generatePieces()
+{
+	knots.clear();
+	deviation = 0;
+	for (std::size_t segment = 0; segment < coefficients.size(); ++segment)
+	{
+		SegmentCoefficients &c = coefficients[segment];
+		c.knot = knots.size();
+		c.pieces = 0u;
+		if (!(tolerance > T(0)))
+			continue;
+
+		// A chord over [a, a+h] is at most h^2/8 max |center''| away
+		// from the cubic; center'' is linear, so the maximum is at an
+		// end. Segments that need more than maxPieces pieces are left
+		// to the exact search, which is then faster.
+		T maxSecond = 0;
+		for (unsigned k = 0; k <= 1u; ++k)
+		{
+			FPVector second;
+			for (unsigned d = 0; d < 3u; ++d)
+				second[d] = T(2) * c.center[d][2] + T(6 * k) * c.center[d][3];
+			maxSecond = std::max(maxSecond, cvmlcpp::modulus(second));
+		}
+
+		unsigned pieces = 1u;
+		while (pieces <= unsigned(maxPieces) &&
+		       maxSecond / T(8 * pieces * pieces) > tolerance)
+			++pieces;
+		if (pieces > unsigned(maxPieces))
+			continue;
+		c.pieces = pieces;
+		deviation = std::max(deviation, maxSecond / T(8 * pieces * pieces));
+
+		for (unsigned i = 0; i <= c.pieces; ++i)
+		{
+			const T t = T(i) / T(c.pieces);
+			const FPPoint point = this->centerAt(segment, t);
+			knots.push_back(t);
+			knots.push_back(point[X]);
+			knots.push_back(point[Y]);
+			knots.push_back(point[Z]);
+		}
+
+	}
+}
+
+template <typename T>
+bool Tube<T>::frameAt(const SegmentCoefficients &c, const T t,
+		      FPVector orientation[3]) const
+{
+	const FPVector rv(detail::horner(c.rotVector[X], t),
+			  detail::horner(c.rotVector[Y], t),
+			  detail::horner(c.rotVector[Z], t));
+	assert(std::abs(cvmlcpp::modulus(rv)-1) < 0.00001);
+
+	return Point<T>::recomputeOrientation(rv, detail::horner(c.angle, t), orientation);
+}
+
+template <typename T>
+T Tube<T>::frameError(const SegmentCoefficients &c) const
+{
+	// Compare the exact frame halfway between entries with the blend
+	// of the entries.
+	T error = 0;
+	FPVector previous[3], next[3], middle[3];
+	this->frameAt(c, T(0), previous);
+	for (unsigned i = 1; i <= c.frameSteps; ++i)
+	{
+		this->frameAt(c, T(i) / T(c.frameSteps), next);
+		this->frameAt(c, (T(i) - T(0.5)) / T(c.frameSteps), middle);
+		for (unsigned k = 0; k < 3u; ++k)
+		{
+			for (unsigned d = 0; d < 3u; ++d)
+				error = std::max(error, std::abs(middle[k][d] -
+					(previous[k][d] + next[k][d]) / T(2)));
+			previous[k] = next[k];
+		}
+	}
+
+	return error;
+}
+
 template <typename T>
 bool Tube<T>::updateMinDistSq(const std::size_t segment, const FPPoint &p,
 		const T &t, T &minDistSq, T &best) const
@@ -315,7 +857,7 @@ bool Tube<T>::updateMinDistSq(const std::size_t segment, const FPPoint &p,
 	assert(t <= 1.0);
 
 	// find vector from point to center(i)
-	FPVector cp = p - this->center(T(segment)+t);
+	FPVector cp = p - this->centerAt(segment, t);
 	const T distSq = cvmlcpp::dotProduct(cp, cp);
 
 	// Closer to axis than best closest point sofar ?
@@ -336,171 +878,60 @@ bool Tube<T>::updateMinDistSq(const std::size_t segment, const FPPoint &p,
  * to the point 'p'.
  * Calculating the distance requires taking the square root of a 6th
  * degree polynomial; minimizing the distance implies minimizing the
- * the 6th degree polynomial. To do this, we need to find the roots of
- * its derivative, itself a 5th degree polynomial. To do this we either
- * a) use gsl; or b) use a newton-raphson procedure with intelligently
- * chosen starting point.
- * Using gsl is preffered.
+ * the 6th degree polynomial. The minimum is either at an end of the
+ * segment or at a real root in [0, 1] of its derivative, itself a 5th
+ * degree polynomial.
  */
-#ifdef USE_GSL
 template <typename T>
-bool Tube<T>::findTSegment(const std::size_t segment, const FPPoint &p, T &t) const
+bool Tube<T>::findTSegment(const std::size_t segment, const FPPoint &p, T &t,
+			   const T hint) const
 {
-	// Create the derivative of the distance to p - a 5th degree Polynomial3
-	const cvmlcpp::Polynomial<T, 5> derivative1DistSq =
-		this->distSqPoly(segment, p).derivative();
-
-	int terms = 6;
-	while ( (terms > 0) && (derivative1DistSq[terms-1] == 0) )
-		--terms;
-
-	gsl_poly_complex_workspace *w = gsl_poly_complex_workspace_alloc(terms);
-	if (w == NULL) // If somehow the workspace wasn't created...
+	// Create the derivative of the distance to p - a 5th degree Polynomial
+	T a[6];
+	this->distSqDerivative(segment, p, a);
+
+	// If p is close enough to a segment that is nearly straight, the
+	// derivative is increasing: the closest point is an end, or the single
+	// root, near the projection of p on the line through the ends.
+	const SegmentCoefficients &c = coefficients[segment];
+	const SegmentBounds &b = bounds[segment];
+	T farthestSq = 0;
+	for (unsigned d = 0; d < 3u; ++d)
 	{
-		// ...fall back to newton-raphson
-		return findTSegment_NewtonRaphson(segment, p, t, derivative1DistSq);
+		const T far = std::max(std::abs(p[d] - b.lower[d]), std::abs(p[d] - b.upper[d]));
+		farthestSq += far * far;
 	}
-	assert(w != NULL);
-
-	// Try to evaluate
-	double a[6];
-	std::copy(derivative1DistSq.begin(), derivative1DistSq.end(), a);
-	double z[10];
-
-	const int result = gsl_poly_complex_solve(a, terms, w, z);
-	gsl_poly_complex_workspace_free (w);
-	if (result != GSL_SUCCESS) // If root-finding doesn't converge...
+	if (farthestSq < c.straightRangeSq)
 	{
-		// ...fall back to newton-raphson
-		return findTSegment_NewtonRaphson(segment, p, t, derivative1DistSq);
+		const T derivative1 = a[0] + a[1] + a[2] + a[3] + a[4] + a[5];
+		if (!(a[0] < T(0)))
+			t = 0.0;
+		else if (!(derivative1 > T(0)))
+			t = 1.0;
+		else
+		{
+			// On a straight segment the derivative is linear, and this
+			// is the projection of p on the line; refine from there.
+			const T start = a[0] / (a[0] - derivative1);
+			t = detail::polishRoot<5>(a, T(0), T(1), true, start);
+		}
+		return true;
 	}
 
+	T roots[5];
+	const std::size_t nRoots = unitIntervalRoots<5>(a, roots, hint);
+
 	// Initial invalid flag value
 	t = -1.0;
 	// Find best of valid solutions...
 	T minDistSq = std::numeric_limits<T>::max();
-	for (int i = 0; i < terms-1; ++i)
-	{
-		const T real = z[2*i];
-		const T imag = z[2*i+1];
-		if ( (real >= 0.0) && (real <= 1.0) && // In range?
-		     (std::abs(imag) < 1e-20) ) // Not complex?
-			updateMinDistSq(segment, p, real, minDistSq, t); // Improvement?
-	}
+	for (std::size_t i = 0; i < nRoots; ++i)
+		updateMinDistSq(segment, p, roots[i], minDistSq, t); // Improvement?
 	// ...and try endpoints too.
 	updateMinDistSq(segment, p, 0.0, minDistSq, t); // Improvement?
 	updateMinDistSq(segment, p, 1.0, minDistSq, t); // Improvement?
 
 	return t != -1.0;
 }
-/*
-template <>
-bool Tube<double>::findTSegment(const FPPoint &p, double &t) const
-{
-
-}
-*/
-#else
-// No gsl, pass directly to Newton-Raphson
-template <typename T>
-bool Tube<T>::findTSegment(const std::size_t segment, const FPPoint &p, T &t) const
-{
-	return findTSegment_NewtonRaphson(segment, p, t,
-		this->distSqPoly(segment, p).derivative());
-}
-#endif
-
-/*
- * This entire section is required only if gsl is not available or if
- * gsl fails to find the roots.
- */
-
-template <typename T>
-bool Tube<T>::findTSegment_NewtonRaphson(const std::size_t segment, const FPPoint &p, T &t,
-				const cvmlcpp::Polynomial<T, 5> &derivative1DistSq) const
-{
-	const unsigned iterations = 128;
-	const T verySmall = 0.0000001;
-
-	cvmlcpp::Polynomial<T, 4> derivative2DistSq = derivative1DistSq.derivative();
-	cvmlcpp::Polynomial<T, 3> derivative3DistSq = derivative2DistSq.derivative();
-
-	T minDistSq = std::numeric_limits<T>::max();
-
-	t = -1.0;
-
-/*
-	// Try cached result
-	if (cachedT >= 0.0 && cachedT <= 1.0)
-	{
-		T guess = cachedT;
-		if ( doNewtonRaphson(derivative1DistSq, derivative2DistSq,
-			    guess, 0.0 , 1.0, iterations) &&
-		     (updateMinDistSq(segment, p, guess, minDistSq)) )
-			cachedT = t = guess;
-		tried.push_back(guess);
-	}
-*/
-	// From now on, do not determine distance if close to cachedT
-
-	// Try t = 0
-	T t0 = 0.0;
-	if ( cvmlcpp::doNewtonRaphson(derivative1DistSq, derivative2DistSq,
-			     t0, 0.0 , 1.0, iterations) )
-		updateMinDistSq(segment, p, t0, minDistSq, t);
-
-	// Try t = 1
-	T t1 = 1.0;
-	if ( doNewtonRaphson(derivative1DistSq, derivative2DistSq,
-			     t1, 0.0 , 1.0, iterations) )
-		updateMinDistSq(segment, p, t1, minDistSq, t);
-
-	// Try zero-points of 2nd degree taylor-approximation of
-	// derative of distSq as starting points.
-	// I.e. Solve f(x) = d1 + d2*x + d3/2 * x^2 == 0
-	// The function is centered around t=0.5, so t= x+0.5
-	const T d1 = derivative1DistSq(0.5);
-	const T d2 = derivative2DistSq(0.5);
-	const T d3 = derivative3DistSq(0.5);
-
-	const T disc = d2*d2 - 2.0 * d3 * d1;
-// cout << endl << "Disc " << disc << " d1 " << d1 << " d2 " << d2 << " d3 "
-// 	<< d3 << endl;
-
-	if ( (disc >= 0.0) && (std::abs(d3) > verySmall) )
-	{
-		T guessA = 0.5 - (d2 - sqrt(disc)) / d3;
-		if (guessA >= 0.0 && guessA <= 1.0)
-		{
-			if ( doNewtonRaphson(derivative1DistSq, derivative2DistSq,
-						guessA, 0.0 , 1.0, iterations) )
-				updateMinDistSq(segment, p, guessA, minDistSq, t);
-		}
-
-		T guessB = 0.5 - (d2 + sqrt(disc)) / d3;
-		if (guessB >= 0.0 && guessB <= 1.0)
-		{
-			if ( doNewtonRaphson(derivative1DistSq, derivative2DistSq,
-						guessB, 0.0 , 1.0, iterations) )
-				updateMinDistSq(segment, p, guessB, minDistSq, t);
-		}
-	}
-	else if (std::abs(d2) > verySmall)
-	{
-		// If d3 = 0; then it is a linear function, not 2nd d
-		//  so we solve f(x) = d1 + d2*x == 0
-		T guess = 0.5 - d1 / d2;
-		if (guess >= 0.0 && guess <= 1.0)
-		{
-			if ( doNewtonRaphson(derivative1DistSq, derivative2DistSq,
-						guess, 0.0 , 1.0, iterations) )
-				updateMinDistSq(segment, p, guess, minDistSq, t);
-		}
-	}
-
-	assert( (t == -1.0) || (t >= 0.0 && t <= 1.0) );
-
-	return (t >= 0.0 && t <= 1.0);
-}
 
 } // end namespace
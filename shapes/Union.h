@@ -23,10 +23,16 @@
 
 #include <vector>
 #include <shapes/Structure.h>
+#include <shapes/BoxTree.h>
+#include <shapes/SphereClusters.h>
+#include <shapes/Power.h>
 
 namespace shapes
 {
 
+template <typename T>
+class SphereCloud;
+
 template <typename T>
 class Union : public Structure<T>
 {
@@ -35,10 +41,12 @@ class Union : public Structure<T>
 		typedef typename Structure<T>::FPVector FPVector;
 
 		Union(const std::string name__ = "", T _exponent = 2.) :
-			Structure<T>(name__), exponent(_exponent) { }
+			Structure<T>(name__), exponent(_exponent), tolerance(0)
+		{ this->setPowers(); }
 
 		Union(T _exponent, const std::string name__ = "") :
-			Structure<T>(name__), exponent(_exponent) { }
+			Structure<T>(name__), exponent(_exponent), tolerance(0)
+		{ this->setPowers(); }
 
 		virtual ~Union();
 
@@ -69,18 +77,86 @@ class Union : public Structure<T>
 			}
 		}
 
+		// If all structures have one, the box around their supports
+		virtual bool getSupport(FPPoint &lower, FPPoint &upper) const;
+
 		virtual void print(unsigned int indent) const;
 
+		virtual void compile(CompiledShape<T> &compiled, const unsigned slot) const;
+
+		virtual T cost() const;
+
+		// The support of the structure is taken when it is added; call
+		// index() after changing it.
 		void add(Structure<T> *structure);
 
+		// Index the supports of the structures, so that evaluation
+		// only visits those that do not vanish at a point. Done by
+		// fromXML().
+		void index();
+
 		void clear();
 
+		/*
+		 * Approximate the terms of distant clusters of undamped spheres
+		 * in the union, such that values near 1 are off by at most
+		 * about 'tolerance'; zero means exact. Only used if there are
+		 * at least minClustered such spheres, and not by compiled code.
+		 */
+		bool setTolerance(const T _tolerance);
+
+		T getTolerance() const { return tolerance; }
+
+		/*
+		 * The same union as a SphereCloud, if all structures in it
+		 * are Spheres; the Tolerance is not carried over.
+		 */
+		bool toSphereCloud(SphereCloud<T> &cloud) const;
+
 		bool empty() const { return structures.empty(); }
 
 	private:
 		virtual T rawValue(const FPPoint &p) const;
+		virtual void rawValues(const FPPoint * const pts, T * const out,
+				       const std::size_t n) const;
+		virtual void rawInside(const FPPoint * const pts, bool * const out,
+				       const std::size_t n) const;
 		std::vector<Structure<T> *> structures;
 		T exponent;
+
+		// Supports of the structures, if 'bounded'
+		std::vector<FPPoint> supportLower, supportUpper;
+		std::vector<char> bounded;
+		std::vector<T> costs;
+
+		// Bounded structures, except those added after index(); and
+		// the others, which are always evaluated.
+		BoxTree<T> supportTree;
+		std::vector<std::size_t> unindexed;
+
+		// Spheres approximated by clusters, and their indices
+		T tolerance;
+		SphereClusters<T> clusters;
+		std::vector<std::size_t> clustered;
+		enum { minClustered = 64 };
+
+		// Sorted indices of structures that may not vanish in the box
+		void activeStructures(const FPPoint &lower, const FPPoint &upper,
+				      std::vector<std::size_t> &active) const;
+
+		// No supports indexed: all structures are candidates, in order,
+		// and finding the active ones is not worth allocating for.
+		bool allUnindexed() const
+		{ return supportTree.empty() && unindexed.size() == structures.size(); }
+
+		// x^exponent and x^(1/exponent)
+		Power<T> power, root;
+
+		void setPowers()
+		{
+			power.set(exponent);
+			root.set(T(1) / exponent);
+		}
 };
 
 } // end namespace
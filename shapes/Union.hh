@@ -24,9 +24,13 @@
 #include <boost/lexical_cast.hpp>
 
 #include "Sphere.h"
+#include "SphereCloud.h"
+#include "Repeat.h"
+#include "Instance.h"
 #include "Tube.h"
 #include "Intersection.h"
 #include "Difference.h"
+#include "CompiledShape.h"
 
 namespace shapes
 {
@@ -45,25 +49,376 @@ void Union<T>::clear()
 		delete *i;
 
 	structures.clear();
+	supportLower.clear();
+	supportUpper.clear();
+	bounded.clear();
+	costs.clear();
+	supportTree.clear();
+	unindexed.clear();
+	clusters.clear();
+	clustered.clear();
 	this->setName("");
 }
 
 template <typename T>
 void Union<T>::add(Structure<T> *structure)
 {
+	FPPoint lower, upper;
+	// Structures vanishing outside their support add nothing there,
+	// provided that power(0) = 0.
+	const bool b = (exponent > T(0)) && structure->getSupport(lower, upper);
+
 	structures.push_back(structure);
+	supportLower.push_back(lower);
+	supportUpper.push_back(upper);
+	bounded.push_back(b);
+	costs.push_back(structure->cost());
+	unindexed.push_back(structures.size() - 1u);
+}
+
+template <typename T>
+void Union<T>::index()
+{
+	for (std::size_t i = 0; i < structures.size(); ++i)
+	{
+		const bool b = (exponent > T(0)) &&
+			structures[i]->getSupport(supportLower[i], supportUpper[i]);
+		bounded[i] = b;
+		costs[i] = structures[i]->cost();
+	}
+
+	// Undamped spheres, if there are enough of them to cluster
+	std::vector<char> isClustered(structures.size(), false);
+	clusters.clear();
+	clustered.clear();
+	if (tolerance > T(0))
+	{
+		std::vector<const Sphere<T> *> spheres;
+		for (std::size_t i = 0; i < structures.size(); ++i)
+		{
+			const Sphere<T> * const sphere =
+				dynamic_cast<const Sphere<T> *>(structures[i]);
+			if (sphere && sphere->getDampLow() == T(1) &&
+			    sphere->getDampHigh() == T(1))
+			{
+				spheres.push_back(sphere);
+				clustered.push_back(i);
+			}
+		}
+
+		if (spheres.size() >= std::size_t(minClustered))
+		{
+			clusters.build(spheres, exponent);
+			for (std::size_t k = 0; k < clustered.size(); ++k)
+				isClustered[clustered[k]] = true;
+		}
+		else
+			clustered.clear();
+	}
+
+	std::vector<std::size_t> items;
+	unindexed.clear();
+	for (std::size_t i = 0; i < structures.size(); ++i)
+		if (bounded[i])
+			items.push_back(i);
+		else if (!isClustered[i])
+			unindexed.push_back(i);
+	supportTree.build(supportLower, supportUpper, items);
+}
+
+template <typename T>
+bool Union<T>::setTolerance(const T _tolerance)
+{
+	if (!(_tolerance >= T(0)))
+		return false;
+
+	tolerance = _tolerance;
+	this->index();
+
+	return true;
+}
+
+template <typename T>
+bool Union<T>::toSphereCloud(SphereCloud<T> &cloud) const
+{
+	for (std::size_t i = 0; i < structures.size(); ++i)
+		if (!dynamic_cast<const Sphere<T> *>(structures[i]))
+			return false;
+
+	cloud = SphereCloud<T>(this->name(), exponent);
+	cloud.setDamping(this->dampLow, this->dampHigh);
+	for (std::size_t i = 0; i < structures.size(); ++i)
+		cloud.add(*static_cast<const Sphere<T> *>(structures[i]));
+	cloud.index();
+
+	return true;
+}
+
+template <typename T>
+bool Union<T>::getSupport(FPPoint &lower, FPPoint &upper) const
+{
+	if (structures.empty())
+		return false;
+
+	lower =  std::numeric_limits<T>::max();
+	upper = -std::numeric_limits<T>::max();
+	for (std::size_t i = 0; i < structures.size(); ++i)
+	{
+		if (!bounded[i])
+			return false;
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], supportLower[i][d]);
+			upper[d] = std::max(upper[d], supportUpper[i][d]);
+		}
+	}
+
+	return true;
+}
+
+template <typename T>
+T Union<T>::cost() const
+{
+	T c = 1;
+	for (typename std::vector<T>::const_iterator i = costs.begin(); i != costs.end(); ++i)
+		c += *i;
+
+	return c;
+}
+
+template <typename T>
+void Union<T>::activeStructures(const FPPoint &lower, const FPPoint &upper,
+				std::vector<std::size_t> &active) const
+{
+	active.clear();
+	supportTree.query(lower, upper, active);
+	for (std::vector<std::size_t>::const_iterator i = unindexed.begin();
+	     i != unindexed.end(); ++i)
+		if (!bounded[*i] || detail::boxesOverlap<T>(lower, upper,
+					supportLower[*i], supportUpper[*i]))
+			active.push_back(*i);
+
+	// Sums in the same order as without supports
+	if (!supportTree.empty())
+		std::sort(active.begin(), active.end());
 }
 
 template <typename T>
 T Union<T>::rawValue(const FPPoint &p) const
 {
+	if (!clusters.empty())
+	{
+		T val;
+		this->rawValues(&p, &val, 1u);
+		return val;
+	}
+
 	T val = 0.0;
 
+	if (this->allUnindexed())
+	{
+		for (std::size_t i = 0; i < structures.size(); ++i)
+			if (!bounded[i] || detail::boxesOverlap<T>(p, p,
+						supportLower[i], supportUpper[i]))
+				val += power( structures[i]->value(p) );
+		return root(val);
+	}
+
+	std::vector<std::size_t> active;
+	this->activeStructures(p, p, active);
+	for (std::vector<std::size_t>::const_iterator i = active.begin();
+	     i != active.end(); ++i)
+		val += power( structures[*i]->value(p) );
+
+	return root(val);
+}
+
+template <typename T>
+void Union<T>::rawValues(const FPPoint * const pts, T * const out,
+			 const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+	T childValues[Structure<T>::blockSize];
+
+	std::fill(out, out + n, T(0.0));
+	if (n == 0u)
+		return;
+
+	// Box around the points
+	FPPoint lower = pts[0];
+	FPPoint upper = pts[0];
+	for (std::size_t i = 1; i < n; ++i)
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], pts[i][d]);
+			upper[d] = std::max(upper[d], pts[i][d]);
+		}
+
+	// Sums in S = sum of value^exponent are off by exponent times as
+	// much as S^(1/exponent) near 1.
+	if (!clusters.empty())
+	{
+		std::vector<std::size_t> exact;
+		clusters.approximate(pts, n, tolerance * exponent, out, exact);
+		for (std::vector<std::size_t>::const_iterator i = exact.begin();
+		     i != exact.end(); ++i)
+		{
+			structures[clustered[*i]]->values(pts, childValues, n);
+			for (std::size_t j = 0; j < n; ++j)
+				out[j] += power(childValues[j]);
+		}
+	}
+
+	// All structures, or those that may not vanish around the points
+	const bool all = this->allUnindexed();
+	std::vector<std::size_t> active;
+	if (!all)
+		this->activeStructures(lower, upper, active);
+	const std::size_t count = all ? structures.size() : active.size();
+
+	// Of bounded structures, only the points in their support
+	FPPoint supported[Structure<T>::blockSize];
+	std::size_t index[Structure<T>::blockSize];
+	for (std::size_t k = 0; k < count; ++k)
+	{
+		const std::size_t i = all ? k : active[k];
+		const Structure<T> * const structure = structures[i];
+		if (!bounded[i])
+		{
+			structure->values(pts, childValues, n);
+			for (std::size_t j = 0; j < n; ++j)
+				out[j] += power(childValues[j]);
+			continue;
+		}
+
+		std::size_t m = 0;
+		for (std::size_t j = 0; j < n; ++j)
+			if (detail::boxesOverlap<T>(pts[j], pts[j],
+					supportLower[i], supportUpper[i]))
+			{
+				supported[m] = pts[j];
+				index[m++] = j;
+			}
+		if (m == 0u)
+			continue;
+
+		structure->values(supported, childValues, m);
+		for (std::size_t j = 0; j < m; ++j)
+			out[index[j]] += power(childValues[j]);
+	}
+
+	for (std::size_t j = 0; j < n; ++j)
+		out[j] = root(out[j]);
+}
+
+template <typename T>
+void Union<T>::rawInside(const FPPoint * const pts, bool * const out,
+			 const std::size_t n) const
+{
+	assert(n <= Structure<T>::blockSize);
+
+	// Approximate values are not bounds on the exact ones
+	if (!clusters.empty())
+	{
+		Structure<T>::rawInside(pts, out, n);
+		return;
+	}
+
+	// Points not yet decided, their index in the block, and the sum
+	// for each so far
+	FPPoint rest[Structure<T>::blockSize];
+	std::size_t index[Structure<T>::blockSize];
+	T sums[Structure<T>::blockSize];
+	T childValues[Structure<T>::blockSize];
+	std::size_t m = n;
+	if (n == 0u)
+		return;
+
+	FPPoint lower = pts[0];
+	FPPoint upper = pts[0];
+	for (std::size_t j = 0; j < n; ++j)
+	{
+		rest[j]  = pts[j];
+		index[j] = j;
+		sums[j]  = 0;
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			lower[d] = std::min(lower[d], pts[j][d]);
+			upper[d] = std::max(upper[d], pts[j][d]);
+		}
+	}
+
+	// The union is at least as large as each of its children
+	std::vector<std::size_t> active;
+	this->activeStructures(lower, upper, active);
+	std::vector<std::pair<T, std::size_t> > order(active.size());
+	for (std::size_t k = 0; k < active.size(); ++k)
+		order[k] = std::make_pair(costs[active[k]], active[k]);
+	std::sort(order.begin(), order.end());
+
+	FPPoint supported[Structure<T>::blockSize];
+	std::size_t restIndex[Structure<T>::blockSize];
+	bool decided[Structure<T>::blockSize];
+	for (std::size_t k = 0; k < order.size() && m > 0u; ++k)
+	{
+		const std::size_t s = order[k].second;
+
+		// Undecided points in the support of the structure
+		std::size_t supportedCount = 0;
+		for (std::size_t j = 0; j < m; ++j)
+		{
+			decided[j] = false;
+			if (!bounded[s] || detail::boxesOverlap<T>(rest[j], rest[j],
+						supportLower[s], supportUpper[s]))
+			{
+				supported[supportedCount] = rest[j];
+				restIndex[supportedCount++] = j;
+			}
+		}
+		if (supportedCount == 0u)
+			continue;
+
+		structures[s]->values(supported, childValues, supportedCount);
+		for (std::size_t q = 0; q < supportedCount; ++q)
+		{
+			const std::size_t j = restIndex[q];
+			if (childValues[q] >= T(1))
+			{
+				out[index[j]] = true;
+				decided[j] = true;
+			}
+			else
+				sums[j] += power(childValues[q]);
+		}
+
+		std::size_t kept = 0;
+		for (std::size_t j = 0; j < m; ++j)
+			if (!decided[j])
+			{
+				rest[kept]  = rest[j];
+				index[kept] = index[j];
+				sums[kept]  = sums[j];
+				++kept;
+			}
+		m = kept;
+	}
+
+	for (std::size_t j = 0; j < m; ++j)
+		out[index[j]] = root(sums[j]) >= T(1);
+}
+
+template <typename T>
+void Union<T>::compile(CompiledShape<T> &compiled, const unsigned slot) const
+{
+	compiled.emitClear(slot);
 	for (typename std::vector<Structure<T> *>::const_iterator i = structures.begin();
 	     i != structures.end(); ++i)
-		val += std::pow( (*i)->value(p), exponent );
-
-	return std::pow(val, (1.0f / exponent) );
+	{
+		(*i)->compile(compiled, slot + 1);
+		compiled.emitAccumulate(slot, slot + 1, exponent);
+	}
+	compiled.emitFinish(slot, T(1) / exponent);
+	this->compileDamping(compiled, slot);
 }
 
 template <typename T>
@@ -86,6 +441,7 @@ bool Union<T>::fromXML(TiXmlHandle &root)
 			<< ": Exponent parse failure, Exponent not greater than zero." << std::endl;
 		return false;
 	}
+	this->setPowers();
 
 	if ( (elem = root.FirstChildElement("DampLow").ToElement()) )
 		this->dampLow = lexical_cast<T>(elem->GetText());
@@ -93,6 +449,19 @@ bool Union<T>::fromXML(TiXmlHandle &root)
 	if ( (elem = root.FirstChildElement("DampHigh").ToElement()) )
 		this->dampHigh = lexical_cast<T>(elem->GetText());
 
+	tolerance = 0;
+	if ( (elem = root.FirstChildElement("Tolerance").ToElement()) )
+	{
+		tolerance = lexical_cast<T>(elem->GetText());
+		if (!(tolerance >= T(0)))
+		{
+			std::cout << "Union"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": Tolerance must not be negative." << std::endl;
+			return false;
+		}
+	}
+
 	unsigned spheres = 0;
 	for (TiXmlElement * elem = root.FirstChildElement("Sphere").ToElement();
 	     elem; elem = elem->NextSiblingElement("Sphere") )
@@ -109,7 +478,64 @@ bool Union<T>::fromXML(TiXmlHandle &root)
 			return false;
 		}
 
-		structures.push_back(sphere);
+		this->add(sphere);
+	}
+
+	unsigned sphereClouds = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("SphereCloud").ToElement();
+	     elem; elem = elem->NextSiblingElement("SphereCloud") )
+	{
+		++sphereClouds;
+		SphereCloud<T> * cloud = new SphereCloud<T>();
+		TiXmlHandle	handle(elem);
+		if (!cloud->fromXML(handle))
+		{
+			std::cout << "Union"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure SphereCloud "
+				<< sphereClouds << "." << std::endl;
+			return false;
+		}
+
+		this->add(cloud);
+	}
+
+	unsigned repeats = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Repeat").ToElement();
+	     elem; elem = elem->NextSiblingElement("Repeat") )
+	{
+		++repeats;
+		Repeat<T> * repeat = new Repeat<T>();
+		TiXmlHandle	handle(elem);
+		if (!repeat->fromXML(handle))
+		{
+			std::cout << "Union"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure Repeat "
+				<< repeats << "." << std::endl;
+			return false;
+		}
+
+		this->add(repeat);
+	}
+
+	unsigned instances = 0;
+	for (TiXmlElement * elem = root.FirstChildElement("Instance").ToElement();
+	     elem; elem = elem->NextSiblingElement("Instance") )
+	{
+		++instances;
+		Instance<T> * instance = new Instance<T>();
+		TiXmlHandle	handle(elem);
+		if (!instance->fromXML(handle))
+		{
+			std::cout << "Union"
+				<< (this->name().empty() ? "" : " \""+this->name()+"\"")
+				<< ": parse failure Instance "
+				<< instances << "." << std::endl;
+			return false;
+		}
+
+		this->add(instance);
 	}
 
 	unsigned tubes = 0;
@@ -128,7 +554,7 @@ bool Union<T>::fromXML(TiXmlHandle &root)
 			return false;
 		}
 
-		structures.push_back(tube);
+		this->add(tube);
 	}
 
 	unsigned unions = 0;
@@ -147,7 +573,7 @@ bool Union<T>::fromXML(TiXmlHandle &root)
 			return false;
 		}
 
-		structures.push_back(_union);
+		this->add(_union);
 	}
 
 	unsigned intersections = 0;
@@ -166,7 +592,7 @@ bool Union<T>::fromXML(TiXmlHandle &root)
 			return false;
 		}
 
-		structures.push_back(_intersection);
+		this->add(_intersection);
 	}
 
 	unsigned differences = 0;
@@ -185,8 +611,9 @@ bool Union<T>::fromXML(TiXmlHandle &root)
 			return false;
 		}
 
-		structures.push_back(_difference);
+		this->add(_difference);
 	}
+	this->index();
 
 	return true;
 }
@@ -230,6 +657,14 @@ TiXmlElement * const Union<T>::toXML() const
 		root->LinkEndChild(dampHighElem);
 	}
 
+	if (tolerance != 0)
+	{
+		buf = lexical_cast<std::string>(tolerance);
+		TiXmlElement * const toleranceElem = new TiXmlElement("Tolerance");
+		toleranceElem->LinkEndChild( new TiXmlText(buf.c_str()) );
+		root->LinkEndChild(toleranceElem);
+	}
+
 	for (typename std::vector<Structure<T> *>::const_iterator i = structures.begin();
 	     i != structures.end(); ++i)
 		root->LinkEndChild( (*i)->toXML() );
@@ -263,6 +698,12 @@ void Union<T>::print(unsigned indent) const
 		Structure<T>::printIndented(buf, indent + 1);
 	}
 
+	if (tolerance != 0)
+	{
+		buf = "<Tolerance>"+lexical_cast<std::string>(tolerance)+"</Tolerance>";
+		Structure<T>::printIndented(buf, indent + 1);
+	}
+
 	if (!this->name().empty())
 	{
 		buf = "<Name>"+this->name()+"</Name>";
@@ -23,19 +23,27 @@
 
 // Main Data Structure
 #include <shapes/Shape.h>
+#include <shapes/CompiledShape.h>
 
 // Building Blocks
 #include <shapes/Sphere.h>
+#include <shapes/SphereCloud.h>
 #include <shapes/Tube.h>
 #include <shapes/Union.h>
 #include <shapes/Intersection.h>
 #include <shapes/Difference.h>
+#include <shapes/Repeat.h>
+#include <shapes/Instance.h>
+#include <shapes/Compose.h>
 
 // Processing
 #include <shapes/ImportXML.h>
 #include <shapes/ExportField.h>
+#include <shapes/ExportSlabs.h>
 #include <shapes/ExportITK.h>
 #include <shapes/ExportSTL.h>
+#include <shapes/BitVoxels.h>
+#include <shapes/SpanVoxels.h>
 #include <shapes/ExportVoxels.h>
 #include <shapes/ExportOctree.h>
 
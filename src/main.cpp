@@ -29,7 +29,7 @@ void dump_to_stdout( TiXmlNode* pParent, unsigned int indent = 0 );
 
 void usage(char * const progName)
 {
-	std::cout << "Usage: " << progName << " <-I|-S|-V|-T> <voxelsize> <XML-file> [output]"
+	std::cout << "Usage: " << progName << " <-I|-M|-S|-V|-B|-R|-T> <voxelsize> <XML-file> [output]"
 		  << std::endl;
 	std::cout << "Usage: " << progName << " <XML-file>" << std::endl;
 	exit(1);
@@ -76,8 +76,9 @@ int main(int argc, char **argv)
 		usage(argv[0]);
 
 	std::string outputMode(argv[1]);
-	if ( (outputMode != "-I") && (outputMode != "-S") &&
-	     (outputMode != "-V") && (outputMode != "-T") )
+	if ( (outputMode != "-I") && (outputMode != "-M") && (outputMode != "-S") &&
+	     (outputMode != "-V") && (outputMode != "-B") &&
+	     (outputMode != "-R") && (outputMode != "-T") )
 		usage(argv[0]);
 
 	const T sampleSize = boost::lexical_cast<T>(argv[2]);
@@ -104,6 +105,11 @@ int main(int argc, char **argv)
 		output += ".itk";
 		ok = io::exportITK<T>(output, shape, sampleSize);
 	}
+	else if (outputMode == "-M")
+	{
+		if (argc != 5) output += ".mha";
+		ok = io::exportITK<T>(output, shape, sampleSize, true);
+	}
 	else if (outputMode == "-S")
 	{
 		if (argc != 5) output += ".stl";
@@ -114,6 +120,16 @@ int main(int argc, char **argv)
 		if (argc != 5) output += ".dat";
 		ok = io::exportVoxels<T>(output, shape, sampleSize);
 	}
+	else if (outputMode == "-B")
+	{
+		if (argc != 5) output += ".bits";
+		ok = io::exportBitVoxels<T>(output, shape, sampleSize);
+	}
+	else if (outputMode == "-R")
+	{
+		if (argc != 5) output += ".spans";
+		ok = io::exportSpanVoxels<T>(output, shape, sampleSize);
+	}
 	else if (outputMode == "-T")
 	{
 		if (argc != 5) output += ".tree.xml.zip";//gz";
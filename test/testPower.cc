@@ -0,0 +1,162 @@
+/***************************************************************************
+ *   Copyright (C) 2011 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <iostream>
+#include <cassert>
+
+#include <shapes/Power.h>
+#include <shapes/Sphere.h>
+#include <shapes/Union.h>
+#include <shapes/Intersection.h>
+#include <shapes/Difference.h>
+
+// Specialized powers must stay within a few ULP of std::pow()
+const double maxUlps = 4;
+
+template <typename T>
+bool close(const T a, const T b)
+{
+	return (a == b) || std::abs(a - b) <= maxUlps * std::numeric_limits<T>::epsilon() * std::abs(b);
+}
+
+template <typename T>
+T random(const T low, const T high)
+{
+	return low + (high - low) * T(std::rand()) / T(RAND_MAX);
+}
+
+template <typename T>
+bool testPower()
+{
+	const T exponents [] = { 1, 2, 3, 4, 8, 0.5, 1.5, 2.5, 0.25, 0.75, 1.25,
+				 -1, -2, -4, -0.5, -0.25, -1.5, 1./3., 0.3, 10 };
+	const unsigned nExponents = sizeof(exponents) / sizeof(T);
+
+	bool ok = true;
+	for (unsigned i = 0; i < nExponents; ++i)
+	{
+		const shapes::Power<T> power(exponents[i]);
+		for (unsigned j = 0; j < 10000; ++j)
+		{
+			const T x = std::pow(T(10), random<T>(-4, 4));
+			if (!close(power(x), std::pow(x, exponents[i])))
+			{
+				std::cout << "Power " << exponents[i] << " of " << x << ": "
+					  << power(x) << " != " << std::pow(x, exponents[i])
+					  << std::endl;
+				ok = false;
+				break;
+			}
+		}
+
+		// Vectorized, the same as one at a time
+		T x[100], y[100];
+		for (unsigned j = 0; j < 100; ++j)
+			x[j] = std::pow(T(10), random<T>(-4, 4));
+		power(x, y, 100);
+		for (unsigned j = 0; j < 100; ++j)
+			if (!close(y[j], power(x[j])))
+			{
+				std::cout << "Power " << exponents[i] << " of " << x[j]
+					  << ": " << y[j] << " != " << power(x[j])
+					  << " for many values." << std::endl;
+				ok = false;
+				break;
+			}
+	}
+
+	return ok;
+}
+
+template <typename T>
+bool testStructures()
+{
+	typedef typename shapes::Sphere<T>::FPPoint  FPPoint;
+	typedef typename shapes::Sphere<T>::FPVector FPVector;
+
+	bool ok = true;
+	const T exponents [] = { 2, 3, 4, 2.5 };
+	for (unsigned i = 0; i < sizeof(exponents) / sizeof(T); ++i)
+	{
+		const T e = exponents[i];
+
+		// Children are owned by the combinations
+		shapes::Sphere<T> * const spheres [] = {
+			new shapes::Sphere<T>(FPPoint(0, 0, 0), 1, 1.0, 1, 0, e),
+			new shapes::Sphere<T>(FPPoint(1, 0, 0), 1, 0.5, 1, 0, e),
+			new shapes::Sphere<T>(FPPoint(0, 0, 0), 1, 1.0, 1, 0, e),
+			new shapes::Sphere<T>(FPPoint(1, 0, 0), 1, 0.5, 1, 0, e),
+			new shapes::Sphere<T>(FPPoint(0, 0, 0), 1, 1.0, 1, 0, e),
+			new shapes::Sphere<T>(FPPoint(1, 0, 0), 1, 0.5, 1, 0, e) };
+
+		shapes::Union<T> u(e);
+		u.add(spheres[0]);
+		u.add(spheres[1]);
+		shapes::Intersection<T> n(e);
+		n.add(spheres[2]);
+		n.add(spheres[3]);
+		shapes::Difference<T> d(e);
+		d.addPositive(spheres[4]);
+		d.addNegative(spheres[5]);
+
+		for (unsigned j = 0; j < 10000; ++j)
+		{
+			const FPPoint p(random<T>(-2, 3), random<T>(-2, 2), random<T>(-2, 2));
+
+			// Generic paths
+			const T r [] = { 1.0, 0.5 };
+			const FPPoint c [] = { FPPoint(0, 0, 0), FPPoint(1, 0, 0) };
+			T v[2];
+			for (unsigned k = 0; k < 2; ++k)
+			{
+				const FPVector cp = p - c[k];
+				const T distSq = cp[X]*cp[X] + cp[Y]*cp[Y] + cp[Z]*cp[Z];
+				v[k] = shapes::SphericStructure<T>::capped(
+					std::pow(distSq / (r[k]*r[k]), e / 2) );
+			}
+			const T vu = std::pow(std::pow(v[0], e) + std::pow(v[1], e), 1 / e);
+			const T vn = std::pow(std::pow(v[0], -e) + std::pow(v[1], -e), -1 / e);
+			const T vd = std::pow(std::pow(v[0], -e) + std::pow(v[1], e), -1 / e);
+
+			if (!close(spheres[0]->value(p), v[0]) || !close(spheres[1]->value(p), v[1]) ||
+			    !close(u.value(p), vu) || !close(n.value(p), vn) || !close(d.value(p), vd))
+			{
+				std::cout << "Exponent " << e << ": specialized and generic"
+					  << " values differ." << std::endl;
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	return ok;
+}
+
+int main()
+{
+	const bool ok = testPower<double>() && testPower<float>() &&
+			testStructures<double>();
+	assert(ok);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2011 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <cassert>
+
+#include <shapes/Roots.h>
+
+// Expand (t - r_0)(t - r_1)... into a[0] + a[1] t + ... + a[5] t^5
+void expand(const double * const r, const std::size_t n, double a[6])
+{
+	for (std::size_t i = 0; i < 6; ++i)
+		a[i] = (i == 0) ? 1 : 0;
+	for (std::size_t k = 0; k < n; ++k)
+		for (std::size_t i = 6; i-- > 0; )
+			a[i] = ((i > 0) ? a[i-1] : 0) - r[k] * a[i];
+}
+
+// The roots in [0, 1] of 'a' are 'expected', in order
+bool check(const char * const name, const double a[6],
+	   const double * const expected, const std::size_t n)
+{
+	double roots[5];
+	const std::size_t nRoots = shapes::unitIntervalRoots<5>(a, roots);
+
+	bool ok = (nRoots == n);
+	for (std::size_t i = 0; ok && i < n; ++i)
+		ok = std::abs(roots[i] - expected[i]) <= 1e-12;
+
+	if (!ok)
+	{
+		std::cout << name << ": found";
+		for (std::size_t i = 0; i < nRoots; ++i)
+			std::cout << " " << roots[i];
+		std::cout << ", expected";
+		for (std::size_t i = 0; i < n; ++i)
+			std::cout << " " << expected[i];
+		std::cout << std::endl;
+	}
+
+	return ok;
+}
+
+int main()
+{
+	bool ok = true;
+
+	// 3t^2 - 2t: a root at 0 and one inside
+	{
+		const double a [] = { 0, -2, 3, 0, 0, 0 };
+		const double expected [] = { 0, 2./3. };
+		ok = check("3t^2 - 2t", a, expected, 2) && ok;
+	}
+
+	// Roots at 1 and inside
+	{
+		const double r [] = { 0.3, 1 };
+		double a[6];
+		expand(r, 2, a);
+		ok = check("(t - 0.3)(t - 1)", a, r, 2) && ok;
+	}
+
+	// Roots at both ends and on the first point of subdivision
+	{
+		const double r [] = { 0, 0.5, 1 };
+		double a[6];
+		expand(r, 3, a);
+		ok = check("t(t - 0.5)(t - 1)", a, r, 3) && ok;
+	}
+
+	// Roots outside [0, 1] are ignored
+	{
+		const double r [] = { -0.5, 0, 0.25, 0.75, 1.5 };
+		double a[6];
+		expand(r, 5, a);
+		ok = check("five roots", a, r + 1, 3) && ok;
+	}
+
+	// Random roots inside
+	for (unsigned j = 0; j < 1000; ++j)
+	{
+		double r[5];
+		for (std::size_t i = 0; i < 5; ++i)
+			r[i] = 0.05 + 0.18 * i + 0.1 * double(std::rand()) / double(RAND_MAX);
+		double a[6];
+		expand(r, 5, a);
+		ok = check("random roots", a, r, 5) && ok;
+	}
+
+	assert(ok);
+
+	return ok ? 0 : 1;
+}
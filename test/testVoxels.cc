@@ -0,0 +1,227 @@
+/***************************************************************************
+ *   Copyright (C) 2011 by F. P. Beekhof                                   *
+ *   fpbeekhof@gmail.com                                                   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with program; if not, write to the                              *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include <shapes/BitVoxels.h>
+#include <shapes/SpanVoxels.h>
+
+const std::string fileName = "testVoxels.tmp";
+
+// Random columns with up to three inside runs each
+void randomSpans(shapes::SpanVoxels &voxels, const std::size_t dimX,
+		 const std::size_t dimY, const std::size_t dimZ)
+{
+	voxels.resize(dimX, dimY, dimZ);
+	for (std::size_t c = 0; c < dimX * dimY; ++c)
+	{
+		shapes::SpanVoxels::Index z = 0;
+		for (unsigned s = std::rand() % 4; s > 0; --s)
+		{
+			const shapes::SpanVoxels::Index b = z + std::rand() % 8;
+			const shapes::SpanVoxels::Index e = b + 1 + std::rand() % 8;
+			if (e > dimZ)
+				break;
+			voxels.transitions().push_back(b);
+			voxels.transitions().push_back(e);
+			z = e + 1;
+		}
+		voxels.starts()[c+1] = voxels.transitions().size();
+	}
+}
+
+bool sameSpans(const shapes::SpanVoxels &a, const shapes::SpanVoxels &b)
+{
+	return a.extent(0) == b.extent(0) && a.extent(1) == b.extent(1) &&
+	       a.extent(2) == b.extent(2) && a.starts() == b.starts() &&
+	       a.transitions() == b.transitions();
+}
+
+// Write 'voxels' with column 0 replaced by 'column', and read it back
+bool readCorrupt(const shapes::SpanVoxels &voxels,
+		 const std::vector<shapes::SpanVoxels::Index> &column)
+{
+	shapes::SpanVoxels corrupt;
+	corrupt.resize(voxels.extent(0), voxels.extent(1), voxels.extent(2));
+	corrupt.transitions() = column;
+	corrupt.transitions().insert(corrupt.transitions().end(),
+		voxels.end(0, 0), voxels.transitions().empty() ? 0 :
+		&voxels.transitions()[0] + voxels.transitions().size());
+	for (std::size_t c = 1; c < corrupt.starts().size(); ++c)
+		corrupt.starts()[c] = voxels.starts()[c] -
+				      voxels.starts()[1] + column.size();
+	const bool written = shapes::io::writeSpanVoxels(corrupt, fileName);
+	assert(written);
+
+	shapes::SpanVoxels read;
+	return shapes::io::readSpanVoxels(fileName, read);
+}
+
+// Write 'header' followed by 'bytes' zero bytes
+void writeFile(const std::string &header, const std::size_t bytes)
+{
+	std::ofstream out(fileName.c_str(), std::ios::out |
+				std::ios::binary | std::ios::trunc);
+	out << header;
+	const std::vector<char> zeros(bytes, 0);
+	if (bytes > 0)
+		out.write(&zeros[0], bytes);
+}
+
+int main()
+{
+	bool ok = true;
+
+	// Span voxels survive a round trip
+	{
+		shapes::SpanVoxels voxels, read;
+		randomSpans(voxels, 7, 5, 40);
+		ok = shapes::io::writeSpanVoxels(voxels, fileName) && ok;
+		ok = shapes::io::readSpanVoxels(fileName, read) && ok;
+		ok = sameSpans(voxels, read) && ok;
+		for (std::size_t x = 0; x < 7; ++x)
+		for (std::size_t y = 0; y < 5; ++y)
+		for (std::size_t z = 0; z < 40; ++z)
+			ok = (voxels(x, y, z) == read(x, y, z)) && ok;
+	}
+
+	// Also when empty
+	{
+		shapes::SpanVoxels voxels, read;
+		voxels.resize(3, 2, 10);
+		ok = shapes::io::writeSpanVoxels(voxels, fileName) && ok;
+		ok = shapes::io::readSpanVoxels(fileName, read) && ok;
+		ok = sameSpans(voxels, read) && ok;
+	}
+
+	// Columns with an odd number of transitions, transitions that do not
+	// increase, or that lie beyond the volume are rejected
+	{
+		shapes::SpanVoxels voxels;
+		randomSpans(voxels, 4, 3, 20);
+
+		std::vector<shapes::SpanVoxels::Index> column;
+		column.push_back(2);
+		column.push_back(5);
+		ok = readCorrupt(voxels, column) && ok;
+
+		column.push_back(9);
+		ok = !readCorrupt(voxels, column) && ok;
+
+		column.back() = 5;
+		column.push_back(7);
+		ok = !readCorrupt(voxels, column) && ok;
+
+		column[2] = 3;
+		ok = !readCorrupt(voxels, column) && ok;
+
+		column[2] = 9;
+		column[3] = 21;
+		ok = !readCorrupt(voxels, column) && ok;
+
+		column[3] = 20;
+		ok = readCorrupt(voxels, column) && ok;
+	}
+
+	// Sizes in the header that are too large for the file, or for the
+	// indices, are rejected before anything is allocated
+	{
+		shapes::SpanVoxels read;
+
+		writeFile("SpanVoxels 2 2 10 4000000000000000000\n", 5 * 8);
+		ok = !shapes::io::readSpanVoxels(fileName, read) && ok;
+
+		writeFile("SpanVoxels 4294967296 4294967297 10 0\n", 2 * 8);
+		ok = !shapes::io::readSpanVoxels(fileName, read) && ok;
+
+		writeFile("SpanVoxels 100000000 100000000 10 0\n", 2 * 8);
+		ok = !shapes::io::readSpanVoxels(fileName, read) && ok;
+
+		writeFile("SpanVoxels 1 1 4294967296 0\n", 2 * 8);
+		ok = !shapes::io::readSpanVoxels(fileName, read) && ok;
+		ok = read.empty() && ok;
+
+		writeFile("SpanVoxels 1 1 4294967295 0\n", 2 * 8);
+		ok = shapes::io::readSpanVoxels(fileName, read) && ok;
+		ok = (read.extent(2) == 4294967295u) && ok;
+	}
+
+	// Bit voxels survive a round trip, also with partial words
+	{
+		const std::size_t dimZ [] = { 1, 63, 64, 65, 130 };
+		for (unsigned d = 0; d < 5; ++d)
+		{
+			shapes::BitVoxels voxels(6, 4, dimZ[d]), read;
+			for (std::size_t x = 0; x < 6; ++x)
+			for (std::size_t y = 0; y < 4; ++y)
+			for (std::size_t z = 0; z < dimZ[d]; ++z)
+				voxels.set(x, y, z, std::rand() & 1);
+			ok = shapes::io::writeBitVoxels(voxels, fileName) && ok;
+			ok = shapes::io::readBitVoxels(fileName, read) && ok;
+			ok = (read.extent(0) == 6 && read.extent(1) == 4 &&
+			      read.extent(2) == dimZ[d] &&
+			      read.words() == voxels.words()) && ok;
+		}
+	}
+
+	// Truncated bit voxels are rejected
+	{
+		shapes::BitVoxels voxels(3, 3, 100), read;
+		ok = shapes::io::writeBitVoxels(voxels, fileName) && ok;
+		{
+			std::ofstream out(fileName.c_str(), std::ios::out |
+						std::ios::binary | std::ios::trunc);
+			out << "BitVoxels 3 3 100\n";
+		}
+		ok = !shapes::io::readBitVoxels(fileName, read) && ok;
+		ok = read.empty() && ok;
+	}
+
+	// As are sizes in the header too large for the file
+	{
+		shapes::BitVoxels read;
+
+		writeFile("BitVoxels 100000000 100000000 64\n", 8);
+		ok = !shapes::io::readBitVoxels(fileName, read) && ok;
+
+		writeFile("BitVoxels 4294967296 4294967296 64\n", 8);
+		ok = !shapes::io::readBitVoxels(fileName, read) && ok;
+
+		writeFile("BitVoxels 2 2 18446744073709551615\n", 8);
+		ok = !shapes::io::readBitVoxels(fileName, read) && ok;
+		ok = read.empty() && ok;
+
+		writeFile("BitVoxels 2 2 65\n", 2 * 2 * 2 * 8);
+		ok = shapes::io::readBitVoxels(fileName, read) && ok;
+		ok = (read.extent(2) == 65) && ok;
+	}
+
+	std::remove(fileName.c_str());
+
+	assert(ok);
+
+	return ok ? 0 : 1;
+}